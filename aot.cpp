@@ -0,0 +1,541 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Ahead-of-time translation of a loaded image to a shared object
+
+**************************************************************** */
+
+#include "aot.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unordered_set>
+
+#include "decoder.h"
+#include "jit.h"
+
+using namespace std;
+
+// Bumped whenever the generated code or the frame layout changes, so that
+// stale shared objects in the cache are not used
+static const unsigned int aot_version = 3;
+
+// Upper limit on the size of a translation
+static const unsigned int aot_max_blocks = 20000;
+
+// Start of every generated file: the frame layout (matching jit_frame) and
+// the memory translation cache lookup used by loads and stores
+static const char* const aot_prelude =
+    "#include <stdint.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "struct tlb_entry {\n"
+    "  uint64_t tag;\n"
+    "  uint8_t* data;\n"
+    "  uint64_t* generation;\n"
+    "  uint64_t unused;\n"
+    "};\n"
+    "\n"
+    "struct frame;\n"
+    "typedef unsigned int (*step_helper)(void*, const void*, unsigned int);\n"
+    "\n"
+    "struct frame {\n"
+    "  uint64_t* r;\n"
+    "  uint64_t* pc;\n"
+    "  void* cpu;\n"
+    "  const void* block;\n"
+    "  step_helper step;\n"
+    "  tlb_entry tlb[64];\n"
+    "};\n"
+    "\n"
+    "struct aot_block {\n"
+    "  uint64_t start;\n"
+    "  unsigned int length;\n"
+    "  const uint32_t* words;\n"
+    "  unsigned int (*code)(frame*);\n"
+    "};\n"
+    "\n"
+    "static inline tlb_entry* lookup(frame* f, uint64_t a, uint64_t size) {\n"
+    "  tlb_entry* t = &f->tlb[(a >> 12) & 63];\n"
+    "  if ((a & (size - 1)) != 0 || t->tag != (a & ~4095ULL)) return 0;\n"
+    "  return t;\n"
+    "}\n"
+    "\n"
+    "#define STEP(k) f->step(f->cpu, f->block, k)\n"
+    "\n";
+
+// Constructor
+aot::aot(string directory, bool verbose) {
+  cache_directory = directory;
+  library = nullptr;
+  is_verbose = verbose;
+}
+
+aot::~aot() {
+  // The shared object stays loaded: blocks may still point into it.
+}
+
+void aot::discover(memory* storage, const vector<uint64_t>& roots,
+                   vector<vector<uint32_t>>& found, vector<uint64_t>& starts) {
+  unordered_set<uint64_t> seen;
+  vector<uint64_t> work(roots.rbegin(), roots.rend());
+  while (!work.empty() && starts.size() < aot_max_blocks) {
+    uint64_t address = work.back();
+    work.pop_back();
+    if (address % 4 != 0 || !seen.insert(address).second ||
+        storage->find_page(address) == nullptr) {
+      continue;
+    }
+    uint64_t start = address;
+    vector<uint32_t> words;
+    bool terminated = false;
+    while (!terminated) {
+      uint64_t fetched = storage->read_doubleword(address);
+      uint32_t word = address % 8 ? fetched >> 32 : fetched;
+      decoded_instruction inst;
+      decode(word, inst);
+      words.push_back(word);
+
+      switch (inst.op) {
+        case OP_BEQ:
+        case OP_BNE:
+        case OP_BLT:
+        case OP_BGE:
+        case OP_BLTU:
+        case OP_BGEU:
+          work.push_back(address + 4);
+          work.push_back(address + inst.imm);
+          break;
+        case OP_JAL:
+        case OP_JALR:
+          if (inst.rd != 0) {
+            work.push_back(address + 4);  // return address
+          }
+          if (inst.op == OP_JAL) {
+            work.push_back(address + inst.imm);
+          }
+          break;
+        case OP_MRET:
+          break;
+        default:
+          if (ends_block(inst.op)) {
+            work.push_back(address + 4);  // after a CSR access or trap
+          }
+          break;
+      }
+      terminated = ends_block(inst.op);
+      address += 4;
+      if (!terminated &&
+          (address % 4096 == 0 || words.size() == max_block_length)) {
+        work.push_back(address);
+        terminated = true;
+      }
+    }
+    starts.push_back(start);
+    found.push_back(words);
+  }
+}
+
+// C++ for a register operand
+static string reg(unsigned int r) {
+  return r == 0 ? string("0ULL") : "f->r[" + to_string(r) + "]";
+}
+
+static string constant(uint64_t value) {
+  ostringstream out;
+  out << "0x" << hex << value << "ULL";
+  return out.str();
+}
+
+// Value written to rd by a register-only operation, or "" if op is not one
+static string alu_expression(const decoded_instruction& inst) {
+  string r1 = reg(inst.rs1);
+  string r2 = reg(inst.rs2);
+  string imm = constant(inst.imm);
+  string sh = to_string(inst.imm);
+  switch (inst.op) {
+    case OP_ADDI: return r1 + " + " + imm;
+    case OP_SLTI: return "(uint64_t)((int32_t)" + r1 + " < (int32_t)" + imm + ")";
+    case OP_SLTIU: return "(uint64_t)(" + r1 + " < " + imm + ")";
+    case OP_XORI: return r1 + " ^ " + imm;
+    case OP_ORI: return r1 + " | " + imm;
+    case OP_ANDI: return r1 + " & " + imm;
+    case OP_SLLI: return r1 + " << " + sh;
+    case OP_SRLI: return r1 + " >> " + sh;
+    case OP_SRAI: return "(uint64_t)((int64_t)" + r1 + " >> " + sh + ")";
+    case OP_ADD: return r1 + " + " + r2;
+    case OP_SUB: return r1 + " - " + r2;
+    case OP_SLL: return r1 + " << (" + r2 + " & 0x3f)";
+    case OP_SLT: return "(uint64_t)((int32_t)" + r1 + " < (int32_t)" + r2 + ")";
+    case OP_SLTU: return "(uint64_t)(" + r1 + " < " + r2 + ")";
+    case OP_XOR: return r1 + " ^ " + r2;
+    case OP_SRL: return r1 + " >> (" + r2 + " & 0x3f)";
+    case OP_SRA: return "(uint64_t)((int64_t)" + r1 + " >> (" + r2 + " & 0x3f))";
+    case OP_OR: return r1 + " | " + r2;
+    case OP_AND: return r1 + " & " + r2;
+    case OP_ADDIW: return "(uint64_t)(int64_t)(int32_t)(" + r1 + " + " + imm + ")";
+    case OP_SLLIW:
+      return "(uint64_t)(int64_t)(int32_t)((uint32_t)" + r1 + " << " + sh + ")";
+    case OP_SRLIW:
+      return "(uint64_t)(int64_t)(int32_t)((uint32_t)" + r1 + " >> " + sh + ")";
+    case OP_SRAIW: return "(uint64_t)(int64_t)((int32_t)" + r1 + " >> " + sh + ")";
+    case OP_ADDW:
+      return "(uint64_t)(int64_t)(int32_t)((uint32_t)" + r1 + " + (uint32_t)" +
+             r2 + ")";
+    case OP_SUBW:
+      return "(uint64_t)(int64_t)(int32_t)((uint32_t)" + r1 + " - (uint32_t)" +
+             r2 + ")";
+    case OP_SLLW:
+      return "(uint64_t)(int64_t)(int32_t)((uint32_t)" + r1 + " << (" + r2 +
+             " & 0x1f))";
+    case OP_SRLW:
+      return "(uint64_t)(int64_t)(int32_t)((uint32_t)" + r1 + " >> (" + r2 +
+             " & 0x1f))";
+    case OP_SRAW:
+      return "(uint64_t)(int64_t)((int32_t)" + r1 + " >> (" + r2 + " & 0x1f))";
+    default: return "";
+  }
+}
+
+// Emit the code for instruction k of the block starting at start, whose
+// length instruction words are in the array named words. Returns false if
+// the instruction ends the block.
+static bool emit_instruction(ostream& out, uint64_t start, unsigned int k,
+                             const decoded_instruction& inst,
+                             const string& words, unsigned int length) {
+  uint64_t pc = start + 4 * k;
+  string next = to_string(k + 1);
+  string rd = "f->r[" + to_string(inst.rd) + "]";
+  string r1 = reg(inst.rs1);
+  string r2 = reg(inst.rs2);
+  const char* branch = nullptr;
+  const char* load = nullptr;
+  unsigned int size = 0;
+
+  switch (inst.op) {
+    case OP_LUI:
+    case OP_AUIPC:
+      if (inst.rd != 0) {
+        out << "  " << rd << " = "
+            << constant(inst.op == OP_LUI ? inst.imm : pc + inst.imm) << ";\n";
+      }
+      return true;
+    case OP_JAL:
+      if (inst.rd != 0) out << "  " << rd << " = " << constant(pc + 4) << ";\n";
+      out << "  *f->pc = " << constant(pc + inst.imm) << ";\n";
+      out << "  return " << next << ";\n";
+      return false;
+    case OP_JALR:
+      out << "  {\n    uint64_t target = (" << r1 << " + " << constant(inst.imm)
+          << ") & ~1ULL;\n";
+      if (inst.rd != 0) out << "    " << rd << " = " << constant(pc + 4) << ";\n";
+      out << "    *f->pc = target;\n    return " << next << ";\n  }\n";
+      return false;
+    case OP_BEQ: branch = "%1 == %2"; break;
+    case OP_BNE: branch = "%1 != %2"; break;
+    case OP_BLT: branch = "(int32_t)%1 < (int32_t)%2"; break;
+    case OP_BGE: branch = "(int32_t)%1 >= (int32_t)%2"; break;
+    case OP_BLTU: branch = "%1 < %2"; break;
+    case OP_BGEU: branch = "%1 >= %2"; break;
+    case OP_LB: load = "(uint64_t)(int64_t)(int8_t)"; size = 1; break;
+    case OP_LH: load = "(uint64_t)(int64_t)(int16_t)"; size = 2; break;
+    case OP_LW: load = "(uint64_t)(int64_t)(int32_t)"; size = 4; break;
+    case OP_LBU: load = "(uint64_t)(uint8_t)"; size = 1; break;
+    case OP_LHU: load = "(uint64_t)(uint16_t)"; size = 2; break;
+    case OP_LWU: load = "(uint64_t)(uint32_t)"; size = 4; break;
+    case OP_LD: load = "(uint64_t)"; size = 8; break;
+    case OP_SB: size = 1; break;
+    case OP_SH: size = 2; break;
+    case OP_SW: size = 4; break;
+    case OP_SD: size = 8; break;
+    case OP_FENCE:
+      return true;
+    default: {
+      string expression = alu_expression(inst);
+      if (expression.empty()) {
+        // Illegal, Zicsr and privileged instructions: interpreter
+        out << "  STEP(" << k << ");\n  return " << next << ";\n";
+        return false;
+      }
+      if (inst.rd != 0) out << "  " << rd << " = " << expression << ";\n";
+      return true;
+    }
+  }
+
+  if (branch != nullptr) {
+    string condition = branch;
+    condition.replace(condition.find("%1"), 2, r1);
+    condition.replace(condition.find("%2"), 2, r2);
+    out << "  *f->pc = (" << condition << ") ? " << constant(pc + inst.imm)
+        << " : " << constant(pc + 4) << ";\n";
+    out << "  return " << next << ";\n";
+    return false;
+  }
+
+  out << "  {\n    uint64_t a = " << r1 << " + " << constant(inst.imm) << ";\n";
+  out << "    tlb_entry* t = lookup(f, a, " << size << ");\n";
+  out << "    if (t == 0) {\n      if (STEP(" << k << ")) return " << next
+      << ";\n";
+  if (load != nullptr) {
+    out << "    } else {\n";
+    out << "      uint" << 8 * size << "_t v;\n";
+    out << "      memcpy(&v, t->data + (a & 4095), " << size << ");\n";
+    if (inst.rd != 0) out << "      " << rd << " = " << load << "v;\n";
+    out << "    }\n  }\n";
+  } else {
+    out << "    } else {\n";
+    out << "      uint" << 8 * size << "_t v = (uint" << 8 * size << "_t)" << r2
+        << ";\n";
+    out << "      memcpy(t->data + (a & 4095), &v, " << size << ");\n";
+    out << "      ++*t->generation;\n";
+    if (k + 1 < length) {  // leave if it changed an instruction still to run
+      out << "      if (t->tag == " << constant(start - start % 4096)
+          << " &&\n          memcmp(t->data + " << (pc + 4) % 4096 << ", "
+          << words << " + " << next << ", " << 4 * (length - k - 1)
+          << ") != 0) {\n";
+      out << "        *f->pc = " << constant(pc + 4) << ";\n";
+      out << "        return " << next << ";\n      }\n";
+    }
+    out << "    }\n  }\n";
+  }
+  return true;
+}
+
+// A cache entry is only trusted if it belongs to us and nobody else can
+// write it; anything else could be code planted by another user
+static bool trusted(const string& path, bool directory) {
+  struct stat st;
+  if (directory ? stat(path.c_str(), &st) != 0 : lstat(path.c_str(), &st) != 0) {
+    return false;
+  }
+  if (directory ? !S_ISDIR(st.st_mode) : !S_ISREG(st.st_mode)) {
+    return false;
+  }
+  return st.st_uid == getuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+// Create the cache directory, and any missing parents, private to the user
+static void make_directory(const string& path) {
+  for (size_t slash = path.find('/', 1); slash != string::npos;
+       slash = path.find('/', slash + 1)) {
+    mkdir(path.substr(0, slash).c_str(), 0700);
+  }
+  mkdir(path.c_str(), 0700);
+}
+
+// Write text to a new file, failing rather than following an existing one
+static bool write_new_file(const string& file_name, const string& text) {
+  int fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  size_t done = 0;
+  while (done < text.size()) {
+    ssize_t n = write(fd, text.data() + done, text.size() - done);
+    if (n <= 0) {
+      close(fd);
+      return false;
+    }
+    done += n;
+  }
+  return close(fd) == 0;
+}
+
+// Run the compiler directly, without a shell. $CXX may name extra
+// arguments, separated by spaces.
+static bool compile(const string& source_name, const string& output_name) {
+  const char* compiler = getenv("CXX");
+  vector<string> words;
+  istringstream command(compiler ? compiler : "c++");
+  for (string word; command >> word;) {
+    words.push_back(word);
+  }
+  if (words.empty()) {
+    words.push_back("c++");
+  }
+  for (const char* option : {"-O1", "-shared", "-fPIC", "-w", "-o"}) {
+    words.push_back(option);
+  }
+  words.push_back(output_name);
+  words.push_back(source_name);
+  vector<char*> argv;
+  for (string& word : words) {
+    argv.push_back(&word[0]);
+  }
+  argv.push_back(nullptr);
+
+  cout.flush();
+  pid_t child = fork();
+  if (child < 0) {
+    return false;
+  }
+  if (child == 0) {
+    execvp(argv[0], argv.data());
+    _exit(127);
+  }
+  int status;
+  while (waitpid(child, &status, 0) < 0) {
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+bool aot::generate(string file_name, const vector<uint64_t>& starts,
+                   const vector<vector<uint32_t>>& found) {
+  ostringstream out;
+  out << aot_prelude;
+  for (unsigned int b = 0; b < starts.size(); b++) {
+    uint64_t start = starts[b];
+    const vector<uint32_t>& words = found[b];
+    out << "static const uint32_t w" << b << "[] = {";
+    for (unsigned int k = 0; k < words.size(); k++) {
+      out << (k ? ", " : "") << "0x" << hex << words[k] << dec << "U";
+    }
+    out << "};\n\n";
+    out << "static unsigned int b" << b << "(frame* f) {  // " << hex << start
+        << dec << "\n";
+    unsigned int k = 0;
+    while (k < words.size()) {
+      decoded_instruction inst;
+      decode(words[k], inst);
+      out << "  // " << disassemble(inst, start + 4 * k) << "\n";
+      if (!emit_instruction(out, start, k, inst, "w" + to_string(b),
+                            words.size())) {
+        break;
+      }
+      k++;
+    }
+    if (k == words.size()) {  // ran off the end of the block
+      out << "  *f->pc = " << constant(start + 4 * words.size()) << ";\n";
+      out << "  return " << words.size() << ";\n";
+    }
+    out << "}\n\n";
+  }
+  out << "extern \"C\" {\n";
+  out << "extern const unsigned int aot_frame_size = sizeof(frame);\n";
+  out << "extern const unsigned int aot_block_count = " << starts.size()
+      << ";\n";
+  out << "extern const aot_block aot_blocks[] = {\n";
+  for (unsigned int b = 0; b < starts.size(); b++) {
+    out << "  {" << constant(starts[b]) << ", " << found[b].size() << ", w" << b
+        << ", b" << b << "},\n";
+  }
+  if (starts.empty()) {
+    out << "  {0, 0, 0, 0},\n";
+  }
+  out << "};\n}\n";
+  return write_new_file(file_name, out.str());
+}
+
+bool aot::open(string file_name) {
+  void* handle = dlopen(file_name.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (handle == nullptr) {
+    return false;
+  }
+  const unsigned int* frame_size =
+      (const unsigned int*)dlsym(handle, "aot_frame_size");
+  const unsigned int* count =
+      (const unsigned int*)dlsym(handle, "aot_block_count");
+  const aot_block* blocks = (const aot_block*)dlsym(handle, "aot_blocks");
+  if (frame_size == nullptr || count == nullptr || blocks == nullptr ||
+      *frame_size != sizeof(jit_frame)) {
+    dlclose(handle);
+    return false;
+  }
+  library = handle;
+  translated.clear();
+  for (unsigned int b = 0; b < *count; b++) {
+    translated[blocks[b].start] = &blocks[b];
+  }
+  return true;
+}
+
+bool aot::prepare(memory* storage, const vector<uint64_t>& roots) {
+  // The cache key covers the image, the roots and the translator itself
+  uint64_t key = storage->content_hash();
+  for (uint64_t root : roots) {
+    key = (key ^ root) * 0x100000001b3ULL;
+  }
+  key = (key ^ aot_version) * 0x100000001b3ULL;
+  ostringstream name;
+  name << cache_directory << "/rv64sim-" << setw(16) << setfill('0') << hex
+       << key;
+  string library_name = name.str() + ".so";
+
+  translated.clear();
+  make_directory(cache_directory);
+  if (!trusted(cache_directory, true)) {
+    cout << "AOT: " << cache_directory
+         << " is not a private directory of this user, not using it" << endl;
+    return false;
+  }
+  if (trusted(library_name, false) && open(library_name)) {
+    if (is_verbose) {
+      cout << "AOT translation loaded from " << library_name << endl;
+    }
+    return true;
+  }
+
+  vector<uint64_t> starts;
+  vector<vector<uint32_t>> found;
+  discover(storage, roots, found, starts);
+
+  // Per-process names, so concurrent runs of one image do not collide
+  string temporary_name = name.str() + "." + to_string(getpid());
+  string source_name = temporary_name + ".cpp";
+  temporary_name += ".so";
+  remove(source_name.c_str());  // left by an earlier process with our pid
+  if (!generate(source_name, starts, found)) {
+    cout << "AOT: cannot write " << source_name << endl;
+    return false;
+  }
+  bool compiled = compile(source_name, temporary_name) &&
+                  chmod(temporary_name.c_str(), 0700) == 0;
+  remove(source_name.c_str());
+  if (!compiled || rename(temporary_name.c_str(), library_name.c_str()) != 0) {
+    cout << "AOT: compiling " << source_name << " failed" << endl;
+    remove(temporary_name.c_str());
+    return false;
+  }
+  if (!open(library_name)) {
+    cout << "AOT: cannot load " << library_name << endl;
+    return false;
+  }
+  if (is_verbose) {
+    cout << "AOT translated " << dec << starts.size() << " blocks to "
+         << library_name << endl;
+  }
+  return true;
+}
+
+native_block aot::lookup(const basic_block* block) {
+  auto found = translated.find(block->start);
+  if (found == translated.end()) {
+    return nullptr;
+  }
+  const aot_block* b = found->second;
+  if (b->length != block->entries.size()) {
+    return nullptr;
+  }
+  for (unsigned int k = 0; k < b->length; k++) {
+    if (b->words[k] != block->entries[k].inst.raw) {
+      return nullptr;  // modified since translation
+    }
+  }
+  return b->code;
+}
+
+unsigned int aot::size() { return translated.size(); }
@@ -0,0 +1,72 @@
+#ifndef AOT_H
+#define AOT_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Ahead-of-time translation of a loaded image to a shared object
+
+**************************************************************** */
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "block.h"
+#include "memory.h"
+
+using namespace std;
+
+// A block in a translated image, as exported by the shared object. The
+// instruction words it was translated from are kept so that a block whose
+// code has since been modified is not used.
+struct aot_block {
+  uint64_t start;
+  unsigned int length;
+  const uint32_t* words;
+  native_block code;
+};
+
+class aot {
+
+ private:
+  string cache_directory;
+  void* library;  // dlopen handle of the translated image
+  unordered_map<uint64_t, const aot_block*> translated;
+  bool is_verbose;
+
+  // Find the blocks reachable from roots, forming them the same way as
+  // processor::translate_block
+  void discover(memory* storage, const vector<uint64_t>& roots,
+                vector<vector<uint32_t>>& found, vector<uint64_t>& starts);
+
+  // Write C++ source for the blocks
+  bool generate(string file_name, const vector<uint64_t>& starts,
+                const vector<vector<uint32_t>>& found);
+
+  // dlopen a translated image and index its blocks
+  bool open(string file_name);
+
+ public:
+
+  // Constructor
+  aot(string directory, bool verbose);
+  ~aot();
+
+  // Translate the code in storage reachable from roots, or reuse the shared
+  // object cached for the same image and roots. Returns false (leaving
+  // everything to the interpreter) if no translation could be loaded.
+  bool prepare(memory* storage, const vector<uint64_t>& roots);
+
+  // Native code for a block, or nullptr if it is not covered by the
+  // translation or its code has changed
+  native_block lookup(const basic_block* block);
+
+  // Number of blocks in the translation
+  unsigned int size();
+
+};
+
+#endif
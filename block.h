@@ -0,0 +1,92 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Translated basic blocks
+
+**************************************************************** */
+
+#include <cstdint>
+#include <vector>
+
+#include "decoder.h"
+#include "memory.h"
+
+using namespace std;
+
+// Native code for a block, produced by the JIT
+struct jit_frame;
+typedef unsigned int (*native_block)(jit_frame* frame);
+
+// Handlers for pairs of instructions run as one (macro-op fusion). They
+// follow the instruction_op handlers in the handler table; a fused entry
+// covers itself and the entry after it.
+enum fused_op {
+  FUSED_LUI_ADDI = OP_COUNT,
+  FUSED_LUI_ADDIW,
+  FUSED_AUIPC_ADDI,
+  FUSED_AUIPC_JALR,
+  FUSED_SLLI_SRLI,
+  FUSED_SLT_BNE,
+  HANDLER_COUNT
+};
+
+// One instruction of a translated block, with the address of the code that
+// executes it bound in (direct threading)
+struct block_entry {
+  const void* handler;
+  decoded_instruction inst;
+};
+
+// A straight-line run of instructions ending at a control transfer,
+// trap or CSR instruction, translated from a single page
+struct basic_block {
+  uint64_t start;
+  page* source;        // page the instructions were translated from
+  uint64_t generation; // generation of source at translation
+  vector<block_entry> entries;
+  unsigned int successors;     // number of statically known successors
+  uint64_t successor_pc[2];
+  basic_block* successor[2];   // chained successor blocks, once looked up
+  unsigned int executions;     // complete runs since translation
+  native_block native;         // compiled code, if the block is hot
+  uint64_t breakpoint_epoch;   // breakpoints breakpoint_stop was found for
+  unsigned int breakpoint_stop;  // first entry after the first on a breakpoint
+};
+
+// Blocks never hold more than this many instructions
+static const unsigned int max_block_length = 64;
+
+// True if op ends a block: control transfers, and instructions that may
+// trap or change CSRs
+static inline bool ends_block(uint8_t op) {
+  switch (op) {
+    case OP_ILLEGAL:
+    case OP_JAL:
+    case OP_JALR:
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BLT:
+    case OP_BGE:
+    case OP_BLTU:
+    case OP_BGEU:
+    case OP_CSRRW:
+    case OP_CSRRS:
+    case OP_CSRRC:
+    case OP_CSRRWI:
+    case OP_CSRRSI:
+    case OP_CSRRCI:
+    case OP_ECALL:
+    case OP_EBREAK:
+    case OP_MRET:
+    case OP_SFENCE_VMA:
+      return true;
+    default:
+      return false;
+  }
+}
+
+#endif
@@ -0,0 +1,91 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Class members for clint
+
+**************************************************************** */
+
+#include "clint.h"
+
+#include <climits>
+
+using namespace std;
+
+// Registers, by offset. mtimecmp and mtime may also be accessed a word at
+// a time.
+static const uint64_t CLINT_MSIP = 0x0;
+static const uint64_t CLINT_MTIMECMP = 0x4000;
+static const uint64_t CLINT_MTIME = 0xbff8;
+
+// Constructor
+clint::clint(processor* hart) {
+  cpu = hart;
+  msip = 0;
+  mtimecmp = UINT64_MAX;
+  mtime_offset = 0;
+}
+
+uint64_t clint::mtime() { return cpu->get_access_count() + mtime_offset; }
+
+// The part of a doubleword register at offset base read or written by an
+// access of size bytes at offset
+static unsigned int register_shift(uint64_t offset, uint64_t base) {
+  return 8 * (offset - base);
+}
+
+static uint64_t size_mask(unsigned int size) {
+  return size == 8 ? ~0ULL : (1ULL << (8 * size)) - 1;
+}
+
+uint64_t clint::read(uint64_t offset, unsigned int size) {
+  if (offset == CLINT_MSIP) {
+    return msip;
+  }
+  if (offset >= CLINT_MTIMECMP && offset < CLINT_MTIMECMP + 8) {
+    return (mtimecmp >> register_shift(offset, CLINT_MTIMECMP)) &
+           size_mask(size);
+  }
+  if (offset >= CLINT_MTIME && offset < CLINT_MTIME + 8) {
+    return (mtime() >> register_shift(offset, CLINT_MTIME)) & size_mask(size);
+  }
+  return 0;
+}
+
+void clint::write(uint64_t offset, uint64_t data, unsigned int size) {
+  if (offset == CLINT_MSIP) {
+    msip = data & 1;
+    cpu->set_interrupt(0x8, msip);  // mip.MSIP
+  } else if (offset >= CLINT_MTIMECMP && offset < CLINT_MTIMECMP + 8) {
+    unsigned int shift = register_shift(offset, CLINT_MTIMECMP);
+    uint64_t mask = size_mask(size) << shift;
+    mtimecmp = (mtimecmp & ~mask) | ((data << shift) & mask);
+    update_timer();
+  } else if (offset >= CLINT_MTIME && offset < CLINT_MTIME + 8) {
+    unsigned int shift = register_shift(offset, CLINT_MTIME);
+    uint64_t mask = size_mask(size) << shift;
+    uint64_t time = (mtime() & ~mask) | ((data << shift) & mask);
+    mtime_offset = time - cpu->get_access_count();
+    update_timer();
+  }
+}
+
+// The deadline is the instruction count at which mtime reaches mtimecmp,
+// unless that is too far off to happen
+void clint::update_timer() {
+  uint64_t now = cpu->get_access_count();
+  uint64_t time = now + mtime_offset;
+  if (time >= mtimecmp) {
+    cpu->get_scheduler()->cancel(this);
+    cpu->set_interrupt(0x80, true);  // mip.MTIP
+    return;
+  }
+  cpu->set_interrupt(0x80, false);
+  if (mtimecmp - time > UINT64_MAX - now) {
+    cpu->get_scheduler()->cancel(this);
+  } else {
+    cpu->get_scheduler()->schedule(this, now + (mtimecmp - time));
+  }
+}
+
+void clint::fire(uint64_t now) { cpu->set_interrupt(0x80, true); }
@@ -0,0 +1,48 @@
+#ifndef CLINT_H
+#define CLINT_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Core-local interruptor
+
+**************************************************************** */
+
+#include <cstdint>
+
+#include "device.h"
+#include "processor.h"
+#include "scheduler.h"
+
+using namespace std;
+
+// The software and timer interrupts of the only hart: bit 0 of msip drives
+// mip.MSIP, and mip.MTIP is raised while mtime >= mtimecmp. mtime counts
+// instructions executed; the deadline is put on the processor's scheduler
+// rather than compared on every instruction.
+class clint : public device, public timed_event {
+
+ private:
+  processor* cpu;
+  uint32_t msip;
+  uint64_t mtimecmp;
+  uint64_t mtime_offset;  // mtime less the instruction count
+
+  uint64_t mtime();
+
+  // Raise MTIP if the deadline has passed, else lower it and schedule it
+  void update_timer();
+
+ public:
+
+  // Constructor
+  clint(processor* hart);
+
+  uint64_t read(uint64_t offset, unsigned int size);
+  void write(uint64_t offset, uint64_t data, unsigned int size);
+  void fire(uint64_t now);
+
+};
+
+#endif
@@ -9,6 +9,7 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <iomanip>
 #include <stdlib.h>
 #include <ctype.h>
@@ -125,8 +126,44 @@ bool command_match_dot(string& command, unsigned int i, bool& num_present, unsig
 }
 
 
-bool command_match_b(string& command, unsigned int i, bool& address_present, uint64_t& address) {
+// Condition of a conditional breakpoint: "if xN OP VALUE", where OP is one
+// of == != < <= > >= (unsigned) and VALUE is hex
+bool command_match_condition(string& command, unsigned int& i, breakpoint_condition& condition) {
+  if (command.compare(i, 2, "if") != 0) return false;
+  i += 2;
+  if (!command_skip_required_whitespace(command, i)) return false;
+  if (i == command.length() || command[i] != 'x') return false;
+  i++;
+  if (!command_match_decimal_number(command, i, condition.reg) || condition.reg > 31) return false;
+  command_skip_optional_whitespace(command, i);
+  static const struct {
+    const char* text;
+    breakpoint_condition::relation_type relation;
+  } relations[] = {
+    {"==", breakpoint_condition::EQ},  {"!=", breakpoint_condition::NE},
+    {"<=", breakpoint_condition::LEU}, {">=", breakpoint_condition::GEU},
+    {"<", breakpoint_condition::LTU},  {">", breakpoint_condition::GTU},
+  };
+  bool found = false;
+  for (auto& r : relations) {
+    string text = r.text;
+    if (!found && command.compare(i, text.length(), text) == 0) {
+      condition.relation = r.relation;
+      i += text.length();
+      found = true;
+    }
+  }
+  if (!found) return false;
+  command_skip_optional_whitespace(command, i);
+  return command_match_hex_number(command, i, condition.value);
+}
+
+
+bool command_match_b(string& command, unsigned int i, bool& address_present, uint64_t& address, breakpoint_condition& condition) {
   address_present = false;
+  condition.relation = breakpoint_condition::ALWAYS;
+  condition.reg = 0;
+  condition.value = 0;
   if (i == command.length() || command[i] != 'b') return false;
   i++;
   if (i == command.length() || command[i] == '#') return true;
@@ -134,16 +171,47 @@ bool command_match_b(string& command, unsigned int i, bool& address_present, uin
   if (command_match_hex_number(command, i, address)) {
     address_present = true;
     command_skip_optional_whitespace(command, i);
+    if (i < command.length() && command[i] == 'i') {
+      if (!command_match_condition(command, i, condition)) return false;
+      command_skip_optional_whitespace(command, i);
+    }
   }
   return i == command.length() || command[i] == '#';
 }
 
 
-bool command_match_l(string& command, unsigned int i, string& filename) {
-  unsigned int j;
-  if (i == command.length() || command[i] != 'l') return false;
+bool command_match_w(string& command, unsigned int i, bool& address_present, uint64_t& address, bool& reads) {
+  address_present = false;
+  reads = false;
+  if (i == command.length() || command[i] != 'w') return false;
   i++;
+  if (i == command.length() || command[i] == '#') return true;
   if (!command_skip_required_whitespace(command, i)) return false;
+  if (command_match_hex_number(command, i, address)) {
+    address_present = true;
+    command_skip_optional_whitespace(command, i);
+    if (command.compare(i, 2, "rw") == 0) {
+      reads = true;
+      i += 2;
+      command_skip_optional_whitespace(command, i);
+    }
+  }
+  return i == command.length() || command[i] == '#';
+}
+
+
+bool command_match_d(string& command, unsigned int i, uint64_t& address) {
+  if (i == command.length() || command[i] != 'd') return false;
+  i++;
+  if (!command_skip_required_whitespace(command, i)) return false;
+  if (!command_match_hex_number(command, i, address)) return false;
+  command_skip_optional_whitespace(command, i);
+  return i == command.length() || command[i] == '#';
+}
+
+
+bool command_match_file_name(string& command, unsigned int& i, string& filename) {
+  unsigned int j;
   if (i == command.length() || command[i] != '"') return false;
   i++;
   j = i;
@@ -152,6 +220,41 @@ bool command_match_l(string& command, unsigned int i, string& filename) {
   i = j;
   if (i == command.length() || command[i] != '"') return false;
   i++;
+  return true;
+}
+
+
+bool command_match_l(string& command, unsigned int i, string& filename) {
+  if (i == command.length() || command[i] != 'l') return false;
+  i++;
+  if (!command_skip_required_whitespace(command, i)) return false;
+  if (!command_match_file_name(command, i, filename)) return false;
+  command_skip_optional_whitespace(command, i);
+  return i == command.length() || command[i] == '#';
+}
+
+
+bool command_match_lb(string& command, unsigned int i, string& filename, uint64_t& address) {
+  if (command.compare(i, 2, "lb") != 0) return false;
+  i += 2;
+  if (!command_skip_required_whitespace(command, i)) return false;
+  if (!command_match_file_name(command, i, filename)) return false;
+  if (!command_skip_required_whitespace(command, i)) return false;
+  if (!command_match_hex_number(command, i, address)) return false;
+  command_skip_optional_whitespace(command, i);
+  return i == command.length() || command[i] == '#';
+}
+
+
+bool command_match_save(string& command, unsigned int i, string& filename, uint64_t& address, uint64_t& length) {
+  if (command.compare(i, 4, "save") != 0) return false;
+  i += 4;
+  if (!command_skip_required_whitespace(command, i)) return false;
+  if (!command_match_file_name(command, i, filename)) return false;
+  if (!command_skip_required_whitespace(command, i)) return false;
+  if (!command_match_hex_number(command, i, address)) return false;
+  if (!command_skip_required_whitespace(command, i)) return false;
+  if (!command_match_hex_number(command, i, length)) return false;
   command_skip_optional_whitespace(command, i);
   return i == command.length() || command[i] == '#';
 }
@@ -199,13 +302,50 @@ bool command_match_csr(string& command, unsigned int i, bool& data_present, uint
 }
 
 
+bool command_match_snap(string& command, unsigned int i, bool& save, string& name) {
+  if (command.compare(i, 4, "snap") != 0) return false;
+  i += 4;
+  if (!command_skip_required_whitespace(command, i)) return false;
+  if (command.compare(i, 4, "save") == 0) {
+    save = true;
+    i += 4;
+  } else if (command.compare(i, 7, "restore") == 0) {
+    save = false;
+    i += 7;
+  } else {
+    return false;
+  }
+  if (!command_skip_required_whitespace(command, i)) return false;
+  unsigned int j = i;
+  while (j < command.length() && (isalnum(command[j]) || command[j] == '_' ||
+                                  command[j] == '-' || command[j] == '.')) j++;
+  if (j == i) return false;
+  name = command.substr(i, j - i);
+  i = j;
+  command_skip_optional_whitespace(command, i);
+  return i == command.length() || command[i] == '#';
+}
+
+
+bool command_match_word(string& command, unsigned int i, string word) {
+  if (command.compare(i, word.length(), word) != 0) return false;
+  i += word.length();
+  command_skip_optional_whitespace(command, i);
+  return i == command.length() || command[i] == '#';
+}
+
+
 // Command interpreter function
 void interpret_commands(memory* main_memory, processor* cpu, bool verbose) {
 
   string command;
   unsigned int i;
-  bool address_present, data_present, num_present;
-  uint64_t address, data;
+  bool address_present, data_present, num_present, reads;
+  breakpoint_condition condition;
+  bool save;
+  string name;
+  unordered_map<string, unsigned int> snapshots;  // snapshot ids by name
+  uint64_t address, data, length;
   unsigned int num;
   string filename;
 
@@ -253,18 +393,59 @@ void interpret_commands(memory* main_memory, processor* cpu, bool verbose) {
         cpu->execute(num, true);  // Execute specified number of instructions with breakpoint check
       }
     }
-    else if (command_match_b(command, i, address_present, address)) {  // Check for b command
+    else if (command_match_b(command, i, address_present, address, condition)) {  // Check for b command
+      if (!address_present) {  // No address value
+        cpu->clear_breakpoint();  // so just clear breakpoints
+      }
+      else {
+        cpu->set_breakpoint(address, condition);  // Set breakpoint at the address
+      }
+    }
+    else if (command_match_w(command, i, address_present, address, reads)) {  // Check for w command
       if (!address_present) {  // No address value
-        cpu->clear_breakpoint();  // so just clear breakpoint
+        cpu->clear_watchpoints();  // so just clear watchpoints
       }
       else {
-        cpu->set_breakpoint(address);  // Set breakpoint at the address
+        cpu->set_watchpoint(address, reads);  // Watch the doubleword at the address
       }
     }
+    else if (command_match_d(command, i, address)) {  // Check for d command
+      cpu->delete_point(address);  // Remove breakpoint and watchpoint at the address
+    }
     else if (command_match_l(command, i, filename)) {  // Check for l command
       uint64_t start_address;
       if (main_memory->load_file(filename, start_address)) {  // Load using the specified file name
         cpu->set_pc(start_address);
+        cpu->translate_image();
+      }
+    }
+    else if (command_match_lb(command, i, filename, address)) {  // Check for lb command
+      if (main_memory->load_binary(filename, address, length)) {  // Load the file's bytes at the address
+        cout << dec << length << " bytes loaded" << endl;
+      }
+    }
+    else if (command_match_save(command, i, filename, address, length)) {  // Check for save command
+      if (main_memory->save_binary(filename, address, length)) {  // Save the bytes at the address to the file
+        cout << dec << length << " bytes saved" << endl;
+      }
+    }
+    else if (command_match_snap(command, i, save, name)) {  // Check for snap command
+      if (save) {
+        snapshots[name] = cpu->snapshot();  // Save state under the name
+      }
+      else if (snapshots.count(name) == 0) {
+        cout << "Unknown snapshot" << endl;
+      }
+      else {
+        cpu->restore(snapshots[name]);  // Return to the named state
+      }
+    }
+    else if (command_match_word(command, i, "baseline")) {  // Check for baseline command
+      cpu->set_baseline();  // Save the state to reset to
+    }
+    else if (command_match_word(command, i, "reset")) {  // Check for reset command
+      if (!cpu->reset_to_baseline()) {
+        cout << "No baseline" << endl;
       }
     }
     else if (command_match_prv(command, i, num_present, num)) {  // Check for prv command
@@ -290,5 +471,6 @@ void interpret_commands(memory* main_memory, processor* cpu, bool verbose) {
     else {
       cout << "Unrecognized command" << endl;
     }
+    if (cpu->is_halted()) break;  // Ended by the guest
   }
 }
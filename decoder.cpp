@@ -0,0 +1,317 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Instruction decoder
+
+**************************************************************** */
+
+#include "decoder.h"
+
+#include <sstream>
+
+using namespace std;
+
+// Operand layouts, which select how the immediate is extracted and how the
+// instruction is disassembled
+enum instruction_format : uint8_t {
+  FMT_NONE,     // no operands shown
+  FMT_R,        // rd, rs1, rs2
+  FMT_I,        // rd, rs1, imm
+  FMT_LOAD,     // rd, imm(rs1)
+  FMT_S,        // rs2, imm(rs1)
+  FMT_B,        // rs1, rs2, target
+  FMT_U,        // rd, imm[31:12]
+  FMT_J,        // rd, target
+  FMT_SHIFT64,  // rd, rs1, 6-bit shamt
+  FMT_SHIFT32,  // rd, rs1, 5-bit shamt
+  FMT_CSR,      // rd, csr, rs1
+  FMT_CSRI,     // rd, csr, zimm
+  FMT_SYSTEM,   // funct12 in imm, no operands shown
+  FMT_FENCE     // rs1, rs2
+};
+
+// One instruction of the ISA: a word w is this instruction if
+// (w & mask) == match
+struct isa_entry {
+  const char* name;
+  uint8_t op;
+  uint8_t format;
+  uint32_t mask;
+  uint32_t match;
+};
+
+// The ISA description. Entries are in instruction_op order, one per
+// operation. The masks reproduce what the original string decoder checked:
+// SLLI ignores funct7, SRLI/SRAI look only at bit 30, FENCE ignores funct3,
+// and ECALL/EBREAK/MRET accept funct3 000 or 100 and ignore rd and rs1.
+// SFENCE.VMA is matched exactly.
+static constexpr isa_entry isa[] = {
+    {"unknown command", OP_ILLEGAL, FMT_NONE, 0, 0},
+    {"LUI", OP_LUI, FMT_U, 0x0000007f, 0x00000037},
+    {"AUIPC", OP_AUIPC, FMT_U, 0x0000007f, 0x00000017},
+    {"JAL", OP_JAL, FMT_J, 0x0000007f, 0x0000006f},
+    {"JALR", OP_JALR, FMT_LOAD, 0x0000707f, 0x00000067},
+    {"BEQ", OP_BEQ, FMT_B, 0x0000707f, 0x00000063},
+    {"BNE", OP_BNE, FMT_B, 0x0000707f, 0x00001063},
+    {"BLT", OP_BLT, FMT_B, 0x0000707f, 0x00004063},
+    {"BGE", OP_BGE, FMT_B, 0x0000707f, 0x00005063},
+    {"BLTU", OP_BLTU, FMT_B, 0x0000707f, 0x00006063},
+    {"BGEU", OP_BGEU, FMT_B, 0x0000707f, 0x00007063},
+    {"LB", OP_LB, FMT_LOAD, 0x0000707f, 0x00000003},
+    {"LH", OP_LH, FMT_LOAD, 0x0000707f, 0x00001003},
+    {"LW", OP_LW, FMT_LOAD, 0x0000707f, 0x00002003},
+    {"LBU", OP_LBU, FMT_LOAD, 0x0000707f, 0x00004003},
+    {"LHU", OP_LHU, FMT_LOAD, 0x0000707f, 0x00005003},
+    {"SB", OP_SB, FMT_S, 0x0000707f, 0x00000023},
+    {"SH", OP_SH, FMT_S, 0x0000707f, 0x00001023},
+    {"SW", OP_SW, FMT_S, 0x0000707f, 0x00002023},
+    {"ADDI", OP_ADDI, FMT_I, 0x0000707f, 0x00000013},
+    {"SLTI", OP_SLTI, FMT_I, 0x0000707f, 0x00002013},
+    {"SLTIU", OP_SLTIU, FMT_I, 0x0000707f, 0x00003013},
+    {"XORI", OP_XORI, FMT_I, 0x0000707f, 0x00004013},
+    {"ORI", OP_ORI, FMT_I, 0x0000707f, 0x00006013},
+    {"ANDI", OP_ANDI, FMT_I, 0x0000707f, 0x00007013},
+    {"SLLI", OP_SLLI, FMT_SHIFT64, 0x0000707f, 0x00001013},
+    {"SRLI", OP_SRLI, FMT_SHIFT64, 0x4000707f, 0x00005013},
+    {"SRAI", OP_SRAI, FMT_SHIFT64, 0x4000707f, 0x40005013},
+    {"ADD", OP_ADD, FMT_R, 0xfe00707f, 0x00000033},
+    {"SUB", OP_SUB, FMT_R, 0xfe00707f, 0x40000033},
+    {"SLL", OP_SLL, FMT_R, 0xfe00707f, 0x00001033},
+    {"SLT", OP_SLT, FMT_R, 0xfe00707f, 0x00002033},
+    {"SLTU", OP_SLTU, FMT_R, 0xfe00707f, 0x00003033},
+    {"XOR", OP_XOR, FMT_R, 0xfe00707f, 0x00004033},
+    {"SRL", OP_SRL, FMT_R, 0xfe00707f, 0x00005033},
+    {"SRA", OP_SRA, FMT_R, 0xfe00707f, 0x40005033},
+    {"OR", OP_OR, FMT_R, 0xfe00707f, 0x00006033},
+    {"AND", OP_AND, FMT_R, 0xfe00707f, 0x00007033},
+    {"FENCE", OP_FENCE, FMT_NONE, 0x0000007f, 0x0000000f},
+    {"LWU", OP_LWU, FMT_LOAD, 0x0000707f, 0x00006003},
+    {"LD", OP_LD, FMT_LOAD, 0x0000707f, 0x00003003},
+    {"SD", OP_SD, FMT_S, 0x0000707f, 0x00003023},
+    {"ADDIW", OP_ADDIW, FMT_I, 0x0000707f, 0x0000001b},
+    {"SLLIW", OP_SLLIW, FMT_SHIFT32, 0xfe00707f, 0x0000101b},
+    {"SRLIW", OP_SRLIW, FMT_SHIFT32, 0xfe00707f, 0x0000501b},
+    {"SRAIW", OP_SRAIW, FMT_SHIFT32, 0xfe00707f, 0x4000501b},
+    {"ADDW", OP_ADDW, FMT_R, 0xfe00707f, 0x0000003b},
+    {"SUBW", OP_SUBW, FMT_R, 0xfe00707f, 0x4000003b},
+    {"SLLW", OP_SLLW, FMT_R, 0xfe00707f, 0x0000103b},
+    {"SRLW", OP_SRLW, FMT_R, 0xfe00707f, 0x0000503b},
+    {"SRAW", OP_SRAW, FMT_R, 0xfe00707f, 0x4000503b},
+    {"CSRRW", OP_CSRRW, FMT_CSR, 0x0000707f, 0x00001073},
+    {"CSRRS", OP_CSRRS, FMT_CSR, 0x0000707f, 0x00002073},
+    {"CSRRC", OP_CSRRC, FMT_CSR, 0x0000707f, 0x00003073},
+    {"CSRRWI", OP_CSRRWI, FMT_CSRI, 0x0000707f, 0x00005073},
+    {"CSRRSI", OP_CSRRSI, FMT_CSRI, 0x0000707f, 0x00006073},
+    {"CSRRCI", OP_CSRRCI, FMT_CSRI, 0x0000707f, 0x00007073},
+    {"ECALL", OP_ECALL, FMT_SYSTEM, 0xfff0307f, 0x00000073},
+    {"EBREAK", OP_EBREAK, FMT_SYSTEM, 0xfff0307f, 0x00100073},
+    {"MRET", OP_MRET, FMT_SYSTEM, 0xfff0307f, 0x30200073},
+    {"SFENCE.VMA", OP_SFENCE_VMA, FMT_FENCE, 0xfe007fff, 0x12000073}};
+
+static constexpr unsigned int isa_size = sizeof(isa) / sizeof(isa[0]);
+
+static constexpr bool isa_in_op_order() {
+  for (unsigned int i = 0; i < isa_size; i++) {
+    if (isa[i].op != i) return false;
+  }
+  return isa_size == OP_COUNT;
+}
+static_assert(isa_in_op_order(), "isa[] must list each instruction_op in order");
+
+// Two-level decode table, generated from isa[] at compile time.
+// Level 1 is indexed by the 7-bit opcode. It gives the bit range (above
+// funct3) that the opcode's instructions are distinguished by, and where the
+// opcode's part of level 2 starts. Level 2 is indexed by funct3 and that bit
+// range, and holds the isa[] index of the only instruction that can match.
+struct opcode_group {
+  uint16_t base;
+  uint8_t shift;
+  uint8_t width;
+};
+
+// Mask bits of the instructions with the given opcode, above funct3
+static constexpr uint32_t upper_mask(uint32_t opcode) {
+  uint32_t bits = 0;
+  for (unsigned int i = 1; i < isa_size; i++) {
+    if ((isa[i].match & 0x7f) == opcode) bits |= isa[i].mask & 0xffff8000;
+  }
+  return bits;
+}
+
+static constexpr unsigned int lowest_bit(uint32_t bits) {
+  unsigned int n = 0;
+  while (n < 32 && !(bits & (1U << n))) n++;
+  return n;
+}
+
+static constexpr unsigned int highest_bit(uint32_t bits) {
+  unsigned int n = 31;
+  while (n > 0 && !(bits & (1U << n))) n--;
+  return n;
+}
+
+static constexpr unsigned int group_width(uint32_t opcode) {
+  return upper_mask(opcode) == 0
+             ? 0
+             : highest_bit(upper_mask(opcode)) -
+                   lowest_bit(upper_mask(opcode)) + 1;
+}
+
+static constexpr bool opcode_used(uint32_t opcode) {
+  for (unsigned int i = 1; i < isa_size; i++) {
+    if ((isa[i].match & 0x7f) == opcode) return true;
+  }
+  return false;
+}
+
+// Level 2 size: a shared all-illegal group, then one group per opcode used
+static constexpr unsigned int decode_table_size() {
+  unsigned int size = 8;
+  for (uint32_t opcode = 0; opcode < 128; opcode++) {
+    if (opcode_used(opcode)) size += 8U << group_width(opcode);
+  }
+  return size;
+}
+
+template <unsigned int N>
+struct decode_tables {
+  opcode_group group[128];
+  uint8_t slot[N];
+};
+
+static constexpr decode_tables<decode_table_size()> build_decode_tables() {
+  decode_tables<decode_table_size()> t{};
+  unsigned int base = 8;
+  for (uint32_t opcode = 0; opcode < 128; opcode++) {
+    uint8_t candidates[OP_COUNT] = {};
+    unsigned int count = 0;
+    for (unsigned int i = 1; i < isa_size; i++) {
+      if ((isa[i].match & 0x7f) == opcode) candidates[count++] = i;
+    }
+    if (count == 0) continue;
+    uint32_t upper = upper_mask(opcode);
+    unsigned int width =
+        upper ? highest_bit(upper) - lowest_bit(upper) + 1 : 0;
+    unsigned int shift = upper ? lowest_bit(upper) : 15;
+    t.group[opcode].base = base;
+    t.group[opcode].shift = shift;
+    t.group[opcode].width = width;
+    uint32_t known = 0x707f | (((1U << width) - 1) << shift);
+    for (uint32_t key = 0; key < (8U << width); key++) {
+      uint32_t word = opcode | (key & 7) << 12 | (key >> 3) << shift;
+      for (unsigned int c = 0; c < count; c++) {
+        const isa_entry& e = isa[candidates[c]];
+        if (((word ^ e.match) & e.mask & known) == 0) {
+          t.slot[base + key] = candidates[c];
+          break;
+        }
+      }
+    }
+    base += 8U << width;
+  }
+  return t;
+}
+
+static constexpr decode_tables<decode_table_size()> tables =
+    build_decode_tables();
+
+const char* instruction_name(unsigned int op) {
+  return op < OP_COUNT ? isa[op].name : isa[OP_ILLEGAL].name;
+}
+
+// Immediate formats, all sign-extended to 64 bits
+static inline uint64_t imm_i(uint32_t w) { return (int64_t)((int32_t)w >> 20); }
+
+static inline uint64_t imm_s(uint32_t w) {
+  return (int64_t)(int32_t)(((int32_t)(w & 0xfe000000) >> 20) |
+                            ((w >> 7) & 0x1f));
+}
+
+static inline uint64_t imm_b(uint32_t w) {
+  return (int64_t)(int32_t)(((int32_t)(w & 0x80000000) >> 19) |
+                            ((w & 0x80) << 4) | ((w >> 20) & 0x7e0) |
+                            ((w >> 7) & 0x1e));
+}
+
+static inline uint64_t imm_u(uint32_t w) {
+  return (int64_t)(int32_t)(w & 0xfffff000);
+}
+
+static inline uint64_t imm_j(uint32_t w) {
+  return (int64_t)(int32_t)(((int32_t)(w & 0x80000000) >> 11) |
+                            (w & 0xff000) | ((w >> 9) & 0x800) |
+                            ((w >> 20) & 0x7fe));
+}
+
+// Decode a 32-bit instruction word: two table lookups and one mask compare
+void decode(uint32_t word, decoded_instruction& inst) {
+  const opcode_group& g = tables.group[word & 0x7f];
+  uint32_t key = ((word >> 12) & 7) |
+                 ((word >> g.shift) & ((1U << g.width) - 1)) << 3;
+  const isa_entry* e = &isa[tables.slot[g.base + key]];
+  if ((word & e->mask) != e->match) {
+    e = &isa[OP_ILLEGAL];
+  }
+
+  uint64_t imm = 0;
+  switch (e->format) {
+    case FMT_I:
+    case FMT_LOAD: imm = imm_i(word); break;
+    case FMT_S: imm = imm_s(word); break;
+    case FMT_B: imm = imm_b(word); break;
+    case FMT_U: imm = imm_u(word); break;
+    case FMT_J: imm = imm_j(word); break;
+    case FMT_SHIFT64: imm = (word >> 20) & 0x3f; break;
+    case FMT_SHIFT32: imm = (word >> 20) & 0x1f; break;
+    case FMT_CSR:
+    case FMT_CSRI:
+    case FMT_SYSTEM: imm = word >> 20; break;  // CSR number / funct12
+  }
+
+  inst.imm = imm;
+  inst.raw = word;
+  inst.op = e->op;
+  inst.rd = (word >> 7) & 0x1f;
+  inst.rs1 = (word >> 15) & 0x1f;
+  inst.rs2 = (word >> 20) & 0x1f;
+}
+
+// Disassemble a decoded instruction at address pc
+string disassemble(const decoded_instruction& inst, uint64_t pc) {
+  const isa_entry& e = isa[inst.op < OP_COUNT ? inst.op : OP_ILLEGAL];
+  ostringstream out;
+  string rd = "x" + to_string(inst.rd);
+  string rs1 = "x" + to_string(inst.rs1);
+  string rs2 = "x" + to_string(inst.rs2);
+  int64_t imm = inst.imm;
+
+  out << e.name;
+  switch (e.format) {
+    case FMT_R: out << " " << rd << ", " << rs1 << ", " << rs2; break;
+    case FMT_I: out << " " << rd << ", " << rs1 << ", " << imm; break;
+    case FMT_LOAD: out << " " << rd << ", " << imm << "(" << rs1 << ")"; break;
+    case FMT_S: out << " " << rs2 << ", " << imm << "(" << rs1 << ")"; break;
+    case FMT_B:
+      out << " " << rs1 << ", " << rs2 << ", 0x" << hex << pc + inst.imm;
+      break;
+    case FMT_U: out << " " << rd << ", 0x" << hex << (inst.raw >> 12); break;
+    case FMT_J: out << " " << rd << ", 0x" << hex << pc + inst.imm; break;
+    case FMT_SHIFT64:
+    case FMT_SHIFT32: out << " " << rd << ", " << rs1 << ", " << imm; break;
+    case FMT_CSR:
+      out << " " << rd << ", 0x" << hex << inst.imm << ", " << rs1;
+      break;
+    case FMT_CSRI:
+      out << " " << rd << ", 0x" << hex << inst.imm << dec << ", "
+          << (unsigned int)inst.rs1;
+      break;
+    case FMT_FENCE: out << " " << rs1 << ", " << rs2; break;
+    case FMT_NONE:
+      if (inst.op == OP_ILLEGAL) {
+        out << " (" << hex << inst.raw << ")";
+      }
+      break;
+  }
+  return out.str();
+}
@@ -0,0 +1,105 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Instruction decoder
+
+**************************************************************** */
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// Operations recognised by the decoder. OP_ILLEGAL is used for any word
+// that does not match an implemented instruction. The instructions
+// themselves are described by the table in decoder.cpp.
+enum instruction_op : uint8_t {
+  OP_ILLEGAL,
+  OP_LUI,
+  OP_AUIPC,
+  OP_JAL,
+  OP_JALR,
+  OP_BEQ,
+  OP_BNE,
+  OP_BLT,
+  OP_BGE,
+  OP_BLTU,
+  OP_BGEU,
+  OP_LB,
+  OP_LH,
+  OP_LW,
+  OP_LBU,
+  OP_LHU,
+  OP_SB,
+  OP_SH,
+  OP_SW,
+  OP_ADDI,
+  OP_SLTI,
+  OP_SLTIU,
+  OP_XORI,
+  OP_ORI,
+  OP_ANDI,
+  OP_SLLI,
+  OP_SRLI,
+  OP_SRAI,
+  OP_ADD,
+  OP_SUB,
+  OP_SLL,
+  OP_SLT,
+  OP_SLTU,
+  OP_XOR,
+  OP_SRL,
+  OP_SRA,
+  OP_OR,
+  OP_AND,
+  OP_FENCE,
+  OP_LWU,
+  OP_LD,
+  OP_SD,
+  OP_ADDIW,
+  OP_SLLIW,
+  OP_SRLIW,
+  OP_SRAIW,
+  OP_ADDW,
+  OP_SUBW,
+  OP_SLLW,
+  OP_SRLW,
+  OP_SRAW,
+  OP_CSRRW,
+  OP_CSRRS,
+  OP_CSRRC,
+  OP_CSRRWI,
+  OP_CSRRSI,
+  OP_CSRRCI,
+  OP_ECALL,
+  OP_EBREAK,
+  OP_MRET,
+  OP_SFENCE_VMA,
+  OP_COUNT
+};
+
+// A decoded instruction. Everything the execute stage needs is extracted
+// once here, so executing never has to look at the instruction bits again.
+struct decoded_instruction {
+  uint64_t imm;  // sign-extended immediate, shift amount or CSR number
+  uint32_t raw;  // instruction word
+  uint8_t op;    // instruction_op
+  uint8_t rd;
+  uint8_t rs1;   // also the zimm field of CSRRxI
+  uint8_t rs2;
+};
+
+// Decode a 32-bit instruction word
+void decode(uint32_t word, decoded_instruction& inst);
+
+// Mnemonic for an operation, as shown in the verbose trace
+const char* instruction_name(unsigned int op);
+
+// Assembly text for an instruction at address pc
+string disassemble(const decoded_instruction& inst, uint64_t pc);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef DEVICE_H
+#define DEVICE_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Interface of devices on the memory bus
+
+**************************************************************** */
+
+#include <cstdint>
+
+using namespace std;
+
+// A memory-mapped device. Accesses to the range it claims come to read
+// and write with the offset into the range; size is 1, 2, 4 or 8 and the
+// offset a multiple of it.
+class device {
+
+ public:
+
+  virtual ~device() {}
+
+  virtual uint64_t read(uint64_t offset, unsigned int size) = 0;
+  virtual void write(uint64_t offset, uint64_t data, unsigned int size) = 0;
+
+  // Push out anything buffered, such as console output
+  virtual void flush() {}
+
+};
+
+// A range of addresses claimed by a device. Its pages point to it, so
+// finding the page of an address also finds the device.
+struct mmio_region {
+  uint64_t base;
+  uint64_t size;
+  device* handler;
+};
+
+#endif
@@ -0,0 +1,121 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Class members for elf_file
+
+**************************************************************** */
+
+#include "elf_file.h"
+
+#include <elf.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+#ifndef EM_RISCV
+#define EM_RISCV 243
+#endif
+
+// True if count entries of type T at offset lie within the file
+template <typename T>
+static bool inside(uint64_t offset, uint64_t count, uint64_t size) {
+  return offset <= size && count <= (size - offset) / sizeof(T);
+}
+
+bool elf_file::is_elf(const char* data, uint64_t size) {
+  return size >= SELFMAG && memcmp(data, ELFMAG, SELFMAG) == 0;
+}
+
+// Segments are loaded at their physical address, which is where a
+// bare-metal image expects to find them
+bool elf_file::parse(const char* data, uint64_t size) {
+  Elf64_Ehdr header;
+  if (!is_elf(data, size) || size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (header.e_ident[EI_CLASS] != ELFCLASS64 ||
+      header.e_ident[EI_DATA] != ELFDATA2LSB || header.e_machine != EM_RISCV ||
+      header.e_phentsize != sizeof(Elf64_Phdr) ||
+      !inside<Elf64_Phdr>(header.e_phoff, header.e_phnum, size)) {
+    return false;
+  }
+  entry = header.e_entry;
+  segments.clear();
+  for (unsigned int i = 0; i < header.e_phnum; i++) {
+    Elf64_Phdr program;
+    memcpy(&program, data + header.e_phoff + i * sizeof(program),
+           sizeof(program));
+    if (program.p_type != PT_LOAD) {
+      continue;
+    }
+    elf_segment segment;
+    segment.address = program.p_paddr;
+    segment.offset = program.p_offset;
+    segment.file_size = min(program.p_filesz, program.p_memsz);
+    segment.memory_size = program.p_memsz;
+    if (!inside<char>(segment.offset, segment.file_size, size)) {
+      return false;
+    }
+    segments.push_back(segment);
+  }
+  symbols.clear();
+  if (header.e_shentsize == sizeof(Elf64_Shdr) &&
+      inside<Elf64_Shdr>(header.e_shoff, header.e_shnum, size)) {
+    read_symbols(data, size);
+  }
+  return true;
+}
+
+// The symbol table is optional: a stripped file has none, and a damaged
+// one is skipped rather than refusing the file
+void elf_file::read_symbols(const char* data, uint64_t size) {
+  Elf64_Ehdr header;
+  memcpy(&header, data, sizeof(header));
+  const char* sections = data + header.e_shoff;
+  for (unsigned int i = 0; i < header.e_shnum; i++) {
+    Elf64_Shdr table;
+    memcpy(&table, sections + i * sizeof(table), sizeof(table));
+    if (table.sh_type != SHT_SYMTAB || table.sh_link >= header.e_shnum) {
+      continue;
+    }
+    Elf64_Shdr strings;
+    memcpy(&strings, sections + table.sh_link * sizeof(strings),
+           sizeof(strings));
+    uint64_t count = table.sh_size / sizeof(Elf64_Sym);
+    if (!inside<Elf64_Sym>(table.sh_offset, count, size) ||
+        !inside<char>(strings.sh_offset, strings.sh_size, size)) {
+      continue;
+    }
+    const char* names = data + strings.sh_offset;
+    for (uint64_t s = 0; s < count; s++) {
+      Elf64_Sym symbol;
+      memcpy(&symbol, data + table.sh_offset + s * sizeof(symbol),
+             sizeof(symbol));
+      unsigned int type = ELF64_ST_TYPE(symbol.st_info);
+      if (symbol.st_shndx == SHN_UNDEF || symbol.st_name == 0 ||
+          symbol.st_name >= strings.sh_size || type == STT_SECTION ||
+          type == STT_FILE) {
+        continue;
+      }
+      const char* name = names + symbol.st_name;
+      elf_symbol found;
+      found.address = symbol.st_value;
+      found.name.assign(name, strnlen(name, strings.sh_size - symbol.st_name));
+      symbols.push_back(found);
+    }
+  }
+  stable_sort(symbols.begin(), symbols.end(),
+              [](const elf_symbol& a, const elf_symbol& b) {
+                return a.address < b.address;
+              });
+}
+
+uint64_t elf_file::get_entry() { return entry; }
+
+const vector<elf_segment>& elf_file::get_segments() { return segments; }
+
+vector<elf_symbol>& elf_file::get_symbols() { return symbols; }
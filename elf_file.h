@@ -0,0 +1,58 @@
+#ifndef ELF_FILE_H
+#define ELF_FILE_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Headers and symbols of an ELF64 executable
+
+**************************************************************** */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// A PT_LOAD segment: file_size bytes from offset in the file, then zeros
+// up to memory_size
+struct elf_segment {
+  uint64_t address;  // physical (load) address
+  uint64_t offset;
+  uint64_t file_size;
+  uint64_t memory_size;
+};
+
+struct elf_symbol {
+  uint64_t address;
+  string name;
+};
+
+// Reads the parts of a little-endian RISC-V ELF64 file needed to load and
+// run it, from the file's contents in memory
+class elf_file {
+
+ private:
+  uint64_t entry;
+  vector<elf_segment> segments;
+  vector<elf_symbol> symbols;  // defined symbols with names, by address
+
+  void read_symbols(const char* data, uint64_t size);
+
+ public:
+
+  // True if data starts with the ELF magic number
+  static bool is_elf(const char* data, uint64_t size);
+
+  // Read the file header, program headers and symbol table. Returns false
+  // if it is not a RISC-V ELF64 file, or its headers lie outside it.
+  bool parse(const char* data, uint64_t size);
+
+  uint64_t get_entry();
+  const vector<elf_segment>& get_segments();
+  vector<elf_symbol>& get_symbols();
+
+};
+
+#endif
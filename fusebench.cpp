@@ -0,0 +1,152 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Benchmark of macro-op fusion: a loop with 6 fusible pairs in its 16
+   instructions, and a loop of loads, stores and arithmetic with none,
+   each run with fusion off (-nofuse) and on
+
+**************************************************************** */
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "memory.h"
+#include "processor.h"
+
+using namespace std;
+
+static const unsigned int runs = 5;  // best of
+static const uint64_t code_address = 0x1000;
+static const uint64_t data_address = 0x8000;
+
+// Instruction encodings
+static uint32_t r_type(uint32_t funct7, uint32_t rs2, uint32_t rs1,
+                       uint32_t funct3, uint32_t rd, uint32_t opcode) {
+  return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+static uint32_t i_type(int32_t imm, uint32_t rs1, uint32_t funct3, uint32_t rd,
+                       uint32_t opcode) {
+  return (uint32_t)(imm & 0xfff) << 20 | rs1 << 15 | funct3 << 12 | rd << 7 |
+         opcode;
+}
+static uint32_t s_type(int32_t imm, uint32_t rs2, uint32_t rs1,
+                       uint32_t funct3) {
+  return (uint32_t)(imm >> 5 & 0x7f) << 25 | rs2 << 20 | rs1 << 15 |
+         funct3 << 12 | (uint32_t)(imm & 0x1f) << 7 | 0x23;
+}
+static uint32_t u_type(uint32_t imm20, uint32_t rd, uint32_t opcode) {
+  return imm20 << 12 | rd << 7 | opcode;
+}
+static uint32_t bne(uint32_t rs1, uint32_t rs2, int32_t offset) {
+  uint32_t imm = offset;
+  return (imm >> 12 & 1) << 31 | (imm >> 5 & 0x3f) << 25 | rs2 << 20 |
+         rs1 << 15 | 1 << 12 | (imm >> 1 & 0xf) << 8 | (imm >> 11 & 1) << 7 |
+         0x63;
+}
+static uint32_t jal(uint32_t rd, int32_t offset) {
+  uint32_t imm = offset;
+  return (imm >> 20 & 1) << 31 | (imm >> 1 & 0x3ff) << 21 |
+         (imm >> 11 & 1) << 20 | (imm >> 12 & 0xff) << 12 | rd << 7 | 0x6f;
+}
+
+// LUI+ADDI, LUI+ADDIW, SLLI+SRLI, AUIPC+ADDI, SLT+BNE and LUI+ADDI again,
+// with four unfused instructions and the jump back
+static vector<uint32_t> fusible_loop() {
+  vector<uint32_t> code = {
+      u_type(0x12345, 5, 0x37),           // lui x5, 0x12345
+      i_type(0x678, 5, 0, 5, 0x13),       // addi x5, x5, 0x678
+      u_type(0x1, 6, 0x37),               // lui x6, 0x1
+      i_type(-1, 6, 0, 6, 0x1b),          // addiw x6, x6, -1
+      i_type(32, 5, 1, 7, 0x13),          // slli x7, x5, 32
+      i_type(32, 7, 5, 7, 0x13),          // srli x7, x7, 32
+      u_type(0, 8, 0x17),                 // auipc x8, 0
+      i_type(8, 8, 0, 8, 0x13),           // addi x8, x8, 8
+      r_type(0, 6, 5, 2, 9, 0x33),        // slt x9, x5, x6
+      bne(9, 0, 4),                       // bne x9, x0, next
+      u_type(0x2, 10, 0x37),              // lui x10, 0x2
+      i_type(1, 10, 0, 10, 0x13),         // addi x10, x10, 1
+      r_type(0, 6, 5, 0, 11, 0x33),       // add x11, x5, x6
+      r_type(0, 7, 11, 4, 12, 0x33),      // xor x12, x11, x7
+      r_type(0, 10, 12, 6, 13, 0x33)};    // or x13, x12, x10
+  code.push_back(jal(0, -4 * (int32_t)code.size()));
+  return code;
+}
+
+// The same length of loads, stores and arithmetic, none of it fusible
+static vector<uint32_t> unfusible_loop() {
+  vector<uint32_t> code = {
+      i_type(1, 1, 0, 1, 0x13),           // addi x1, x1, 1
+      s_type(0, 1, 2, 3),                 // sd x1, 0(x2)
+      i_type(0, 2, 3, 3, 0x03),           // ld x3, 0(x2)
+      r_type(0, 1, 3, 0, 4, 0x33),        // add x4, x3, x1
+      r_type(0, 1, 4, 4, 5, 0x33),        // xor x5, x4, x1
+      s_type(8, 5, 2, 2),                 // sw x5, 8(x2)
+      i_type(8, 2, 2, 6, 0x03),           // lw x6, 8(x2)
+      r_type(0, 5, 6, 6, 7, 0x33),        // or x7, x6, x5
+      r_type(0, 4, 7, 7, 8, 0x33),        // and x8, x7, x4
+      r_type(0x20, 3, 8, 0, 9, 0x33),     // sub x9, x8, x3
+      s_type(16, 9, 2, 3),                // sd x9, 16(x2)
+      i_type(16, 2, 3, 10, 0x03),         // ld x10, 16(x2)
+      r_type(0, 10, 9, 0, 11, 0x33),      // add x11, x9, x10
+      r_type(0, 11, 1, 4, 12, 0x33),      // xor x12, x1, x11
+      i_type(3, 12, 7, 13, 0x13)};        // andi x13, x12, 3
+  code.push_back(jal(0, -4 * (int32_t)code.size()));
+  return code;
+}
+
+// Seconds to run instructions of the loop, and the pairs fused doing it
+static double time_loop(const vector<uint32_t>& code, bool fusion,
+                        uint64_t instructions, uint64_t& fused) {
+  double best = 0;
+  for (unsigned int r = 0; r < runs; r++) {
+    memory store(false);
+    // Two instructions to a doubleword: both loops are 16 long
+    for (unsigned int k = 0; k < code.size(); k += 2) {
+      store.write_doubleword(code_address + 4 * k,
+                             code[k] | (uint64_t)code[k + 1] << 32,
+                             0xffffffffffffffffULL);
+    }
+    processor cpu(&store, false, false);
+    if (!fusion) {
+      cpu.disable_fusion();
+    }
+    cpu.set_pc(code_address);
+    cpu.set_reg(2, data_address);
+    auto start = chrono::steady_clock::now();
+    for (uint64_t done = 0; done < instructions; done += 100000000) {
+      cpu.execute(min(instructions - done, (uint64_t)100000000), false);
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    fused = cpu.get_fused_pairs();
+    if (r == 0 || elapsed.count() < best) {
+      best = elapsed.count();
+    }
+  }
+  return best;
+}
+
+int main(int argc, char* argv[]) {
+  uint64_t millions = argc > 1 ? stoi(argv[1]) : 200;
+  uint64_t instructions = millions * 1000000;
+  cout << millions << "M instructions per run, best of " << runs << endl;
+  cout << "loop          nofuse     fused   speedup  pairs" << endl;
+  struct {
+    string name;
+    vector<uint32_t> code;
+  } loops[] = {{"fusible", fusible_loop()}, {"unfusible", unfusible_loop()}};
+  for (auto& loop : loops) {
+    uint64_t fused;
+    double plain = time_loop(loop.code, false, instructions, fused);
+    double with_fusion = time_loop(loop.code, true, instructions, fused);
+    cout << setfill(' ') << left << setw(10) << loop.name << right << fixed
+         << setprecision(3) << setw(10) << plain << setw(10) << with_fusion
+         << setprecision(2) << setw(10) << plain / with_fusion << setw(7)
+         << fused << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,151 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Class members for hex_chunk
+
+**************************************************************** */
+
+#include "hex_chunk.h"
+
+#include <cctype>
+
+using namespace std;
+
+// Value of each character as a hex digit, or 0x80 if it is not one. Built
+// on first use, which is safe from any thread.
+struct hex_table {
+  uint8_t values[256];
+  hex_table() {
+    for (unsigned int c = 0; c < 256; c++) {
+      values[c] = 0x80;
+    }
+    for (unsigned int d = 0; d < 10; d++) {
+      values['0' + d] = d;
+    }
+    for (unsigned int d = 0; d < 6; d++) {
+      values['a' + d] = 10 + d;
+      values['A' + d] = 10 + d;
+    }
+  }
+};
+
+static const uint8_t* hex_values() {
+  static const hex_table table;
+  return table.values;
+}
+
+// Decode count bytes from the 2 * count hex digits at text, returning false
+// if any character is not a hex digit. The bad digits are collected and
+// tested once, so the loop has no branches on the data.
+static bool decode_hex(const char* text, uint8_t* bytes, unsigned int count) {
+  const uint8_t* values = hex_values();
+  uint8_t bad = 0;
+  for (unsigned int i = 0; i < count; i++) {
+    uint8_t high = values[(uint8_t)text[2 * i]];
+    uint8_t low = values[(uint8_t)text[2 * i + 1]];
+    bad |= high | low;
+    bytes[i] = high << 4 | low;
+  }
+  return !(bad & 0x80);
+}
+
+// The length, address, type, data and checksum are decoded as one run of
+// hex digits, whose bytes must sum to zero
+hex_record_status read_hex_record(const char*& text, const char* end,
+                                  uint8_t* record) {
+  while (text < end && isspace((uint8_t)*text)) {
+    text++;
+  }
+  if (text == end) {
+    return RECORD_NONE;
+  }
+  if (*text != ':') {
+    return RECORD_NO_COLON;
+  }
+  text++;
+  if (end - text < 2 || !decode_hex(text, record, 1) ||
+      end - text < 2 * (record[0] + 5) ||
+      !decode_hex(text + 2, record + 1, record[0] + 4)) {
+    return RECORD_INVALID;
+  }
+  unsigned int record_length = record[0];
+  text += 2 * (record_length + 5);
+  uint8_t checksum = 0;
+  for (unsigned int i = 0; i < record_length + 5; i++) {
+    checksum += record[i];
+  }
+  return checksum == 0 ? RECORD_OK : RECORD_BAD_CHECKSUM;
+}
+
+// Constructor
+hex_chunk::hex_chunk(const char* chunk_begin, const char* chunk_end) {
+  begin = chunk_begin;
+  end = chunk_end;
+  record_count = 0;
+  error = false;
+  end_of_file = false;
+  base_set = false;
+  base = 0;
+  start_set = false;
+  start_address = 0;
+}
+
+// The extended address and start address records are handled as the
+// sequential loader does
+void hex_chunk::decode() {
+  const char* text = begin;
+  uint8_t record[260];
+  data.reserve((end - begin) / 2);
+  records.reserve((end - begin) / 16);
+  while (true) {
+    hex_record_status status = read_hex_record(text, end, record);
+    if (status == RECORD_NONE) {
+      return;
+    }
+    record_count++;
+    if (status != RECORD_OK) {
+      error = true;
+      return;
+    }
+    unsigned int record_length = record[0];
+    const uint8_t* record_bytes = record + 4;
+    switch (record[3]) {
+      case 0x00: {  // Data record
+        hex_data_record r;
+        r.base = base;
+        r.base_known = base_set;
+        r.address = record[1] << 8 | record[2];
+        r.length = record_length;
+        r.offset = data.size();
+        records.push_back(r);
+        data.insert(data.end(), record_bytes, record_bytes + record_length);
+        break;
+      }
+      case 0x01:  // End of file
+        end_of_file = true;
+        return;
+      case 0x02:  // Extended segment address
+        base = 0;
+        for (unsigned int i = 0; i < record_length; i++) {
+          base = (base << 8) | ((uint64_t)record_bytes[i] << 4);
+        }
+        base_set = true;
+        break;
+      case 0x04:  // Extended linear address
+        base = 0;
+        for (unsigned int i = 0; i < record_length; i++) {
+          base = (base << 8) | ((uint64_t)record_bytes[i] << 16);
+        }
+        base_set = true;
+        break;
+      case 0x05:  // Start linear address
+        start_address = 0;
+        for (unsigned int i = 0; i < record_length; i++) {
+          start_address = (start_address << 8) | record_bytes[i];
+        }
+        start_set = true;
+        break;
+    }
+  }
+}
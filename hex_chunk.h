@@ -0,0 +1,68 @@
+#ifndef HEX_CHUNK_H
+#define HEX_CHUNK_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Decoding of Intel HEX records, a chunk of a file at a time
+
+**************************************************************** */
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+enum hex_record_status {
+  RECORD_OK,
+  RECORD_NONE,          // only whitespace is left
+  RECORD_NO_COLON,
+  RECORD_INVALID,       // not hex digits, or cut short
+  RECORD_BAD_CHECKSUM
+};
+
+// Decode the record at text (after any whitespace) into record: length,
+// address (2 bytes), type, data and checksum. text is moved past it.
+hex_record_status read_hex_record(const char*& text, const char* end,
+                                  uint8_t* record);
+
+// A data record decoded from a chunk. Its bytes are at offset in the
+// chunk's data. The extended address in effect is base, unless the chunk
+// had not set one yet, when it is the one the chunk starts with.
+struct hex_data_record {
+  uint64_t base;
+  bool base_known;
+  uint32_t address;
+  uint32_t length;
+  uint64_t offset;
+};
+
+// A run of whole records of a hex file, decoded on its own. Everything
+// that depends on the records before the chunk (the extended address
+// a data record starts with, line numbers) is resolved afterwards.
+class hex_chunk {
+
+ public:
+  const char* begin;
+  const char* end;
+
+  vector<hex_data_record> records;
+  vector<uint8_t> data;
+  unsigned int record_count;  // records read, up to an error or end of file
+  bool error;                 // a record could not be read
+  bool end_of_file;           // an end of file record was read
+  bool base_set;              // a type 02 or 04 record set base
+  uint64_t base;
+  bool start_set;             // a type 05 record set start_address
+  uint64_t start_address;
+
+  // Constructor
+  hex_chunk(const char* chunk_begin, const char* chunk_end);
+
+  // Decode the records, stopping at an error or an end of file record
+  void decode();
+
+};
+
+#endif
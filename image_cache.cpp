@@ -0,0 +1,230 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Class members for image_cache
+
+**************************************************************** */
+
+#include "image_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+static const char image_magic[8] = {'r', 'v', '6', '4', 'i', 'm', 'g', '1'};
+
+struct image_header {
+  char magic[8];
+  image_key key;
+  uint64_t start_address;
+  uint64_t byte_count;
+  uint64_t run_count;
+  uint64_t page_count;
+};
+
+// Offset of the page data: after the header, runs and page addresses
+static uint64_t data_offset(uint64_t run_count, uint64_t page_count) {
+  uint64_t tables = sizeof(image_header) + 16 * run_count + 8 * page_count;
+  return (tables + 4095) / 4096 * 4096;
+}
+
+// Constructor
+image_cache::image_cache() {
+  mapping = nullptr;
+  length = 0;
+}
+
+image_cache::~image_cache() {
+  if (mapping != nullptr) {
+    munmap(mapping, length);
+  }
+}
+
+string image_cache::sidecar_name(string source_name) {
+  return source_name + ".img";
+}
+
+// FNV-1a, a doubleword at a time, then the odd bytes
+image_key image_cache::key_of(const char* source, uint64_t size,
+                              uint64_t modified) {
+  image_key key;
+  key.size = size;
+  key.modified = modified;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  uint64_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, source + i, 8);
+    hash = (hash ^ word) * 0x100000001b3ULL;
+  }
+  for (; i < size; i++) {
+    hash = (hash ^ (uint8_t)source[i]) * 0x100000001b3ULL;
+  }
+  key.hash = hash;
+  return key;
+}
+
+void image_cache::add(uint64_t address, const uint8_t* bytes,
+                      uint64_t count) {
+  if (!built_runs.empty() &&
+      built_runs.back().first + built_runs.back().second == address) {
+    built_runs.back().second += count;  // records usually follow on
+  } else {
+    built_runs.push_back(make_pair(address, count));
+  }
+  while (count > 0) {
+    uint64_t offset = address % 4096;
+    uint64_t chunk = min(count, 4096 - offset);
+    unique_ptr<uint8_t[]>& p = built_pages[address - offset];
+    if (!p) {
+      p.reset(new uint8_t[4096]());
+    }
+    memcpy(p.get() + offset, bytes, chunk);
+    address += chunk;
+    bytes += chunk;
+    count -= chunk;
+  }
+}
+
+// Written to a temporary file and renamed, so that a sidecar is never seen
+// half written
+bool image_cache::save(string file_name, const image_key& key, uint64_t start,
+                       uint64_t bytes) {
+  sort(built_runs.begin(), built_runs.end());
+  vector<pair<uint64_t, uint64_t>> merged;
+  for (auto& r : built_runs) {
+    if (!merged.empty() &&
+        r.first <= merged.back().first + merged.back().second) {
+      merged.back().second = max(merged.back().first + merged.back().second,
+                                 r.first + r.second) - merged.back().first;
+    } else {
+      merged.push_back(r);
+    }
+  }
+
+  image_header header;
+  memcpy(header.magic, image_magic, sizeof(image_magic));
+  header.key = key;
+  header.start_address = start;
+  header.byte_count = bytes;
+  header.run_count = merged.size();
+  header.page_count = built_pages.size();
+  string temporary = file_name + ".tmp" + to_string(getpid());
+  ofstream output(temporary, ios::binary | ios::trunc);
+  output.write((const char*)&header, sizeof(header));
+  for (auto& r : merged) {
+    output.write((const char*)&r.first, 8);
+    output.write((const char*)&r.second, 8);
+  }
+  for (auto& p : built_pages) {
+    output.write((const char*)&p.first, 8);
+  }
+  uint64_t padding = data_offset(merged.size(), built_pages.size()) -
+                     (sizeof(header) + 16 * merged.size() +
+                      8 * built_pages.size());
+  static const char zeros[4096] = {};
+  output.write(zeros, padding);
+  for (auto& p : built_pages) {
+    output.write((const char*)p.second.get(), 4096);
+  }
+  output.close();
+  if (!output || rename(temporary.c_str(), file_name.c_str()) != 0) {
+    remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Every run must lie in pages that are listed, in address order
+bool image_cache::open(string file_name, const image_key& key) {
+  int fd = ::open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0 ||
+      (uint64_t)status.st_size < sizeof(image_header)) {
+    close(fd);
+    return false;
+  }
+  void* mapped = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+  mapping = mapped;
+  length = status.st_size;
+
+  image_header header;
+  memcpy(&header, mapping, sizeof(header));
+  if (memcmp(header.magic, image_magic, sizeof(image_magic)) != 0 ||
+      header.key.size != key.size || header.key.modified != key.modified ||
+      header.key.hash != key.hash || header.run_count > length / 16 ||
+      header.page_count > length / 4096 ||
+      data_offset(header.run_count, header.page_count) +
+              4096 * header.page_count != length) {
+    return false;
+  }
+  start_address = header.start_address;
+  byte_count = header.byte_count;
+  run_count = header.run_count;
+  page_count = header.page_count;
+  runs = (const uint64_t*)((uint8_t*)mapping + sizeof(header));
+  page_addresses = runs + 2 * run_count;
+  data = (uint8_t*)mapping + data_offset(run_count, page_count);
+
+  for (uint64_t p = 0; p < page_count; p++) {
+    if (page_addresses[p] % 4096 != 0 ||
+        (p > 0 && page_addresses[p] <= page_addresses[p - 1])) {
+      return false;
+    }
+  }
+  for (uint64_t r = 0; r < run_count; r++) {
+    uint64_t address = runs[2 * r];
+    uint64_t end = address + runs[2 * r + 1];
+    while (address < end) {
+      uint64_t page_address = address - address % 4096;
+      if (!binary_search(page_addresses, page_addresses + page_count,
+                         page_address)) {
+        return false;
+      }
+      address = page_address + 4096;
+    }
+  }
+  return true;
+}
+
+uint64_t image_cache::get_start_address() { return start_address; }
+
+uint64_t image_cache::get_byte_count() { return byte_count; }
+
+uint64_t image_cache::get_run_count() { return run_count; }
+
+uint64_t image_cache::run_address(uint64_t r) { return runs[2 * r]; }
+
+uint64_t image_cache::run_length(uint64_t r) { return runs[2 * r + 1]; }
+
+uint64_t image_cache::get_page_count() { return page_count; }
+
+uint64_t image_cache::page_address(uint64_t p) { return page_addresses[p]; }
+
+uint64_t* image_cache::page_data(uint64_t p) {
+  return (uint64_t*)(data + 4096 * p);
+}
+
+pair<void*, uint64_t> image_cache::release() {
+  pair<void*, uint64_t> released = make_pair(mapping, length);
+  mapping = nullptr;
+  length = 0;
+  return released;
+}
@@ -0,0 +1,93 @@
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Binary sidecar caching the result of loading a hex file
+
+**************************************************************** */
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// What the cache was made from. A cache is only used for a source whose
+// size, modification time and contents hash all match.
+struct image_key {
+  uint64_t size;
+  uint64_t modified;
+  uint64_t hash;
+};
+
+// The sidecar (the source's name with ".img" added) holds:
+//   a header: magic, key, start address, byte count, run and page counts
+//   runs:     (address, length) of the bytes the source wrote, merged
+//   pages:    address of each page holding a run
+//   data:     the pages' contents, zero outside the runs, from a 4Kbyte
+//             boundary so that each page can be mapped as a guest page
+// An image is built as the source is loaded, and saved at the end; or
+// opened, mapping the sidecar privately.
+class image_cache {
+
+ private:
+  // Building
+  map<uint64_t, unique_ptr<uint8_t[]>> built_pages;
+  vector<pair<uint64_t, uint64_t>> built_runs;
+
+  // Opened
+  void* mapping;
+  uint64_t length;
+  uint64_t start_address;
+  uint64_t byte_count;
+  const uint64_t* runs;  // pairs of address and length
+  uint64_t run_count;
+  const uint64_t* page_addresses;
+  uint64_t page_count;
+  uint8_t* data;
+
+  image_cache(const image_cache&) = delete;
+  image_cache& operator=(const image_cache&) = delete;
+
+ public:
+
+  // Constructor
+  image_cache();
+  ~image_cache();
+
+  static string sidecar_name(string source_name);
+  static image_key key_of(const char* source, uint64_t size,
+                          uint64_t modified);
+
+  // Building: note length bytes written at address, and write the sidecar.
+  // save returns false if it cannot be written.
+  void add(uint64_t address, const uint8_t* bytes, uint64_t length);
+  bool save(string file_name, const image_key& key, uint64_t start,
+            uint64_t bytes);
+
+  // Map a sidecar, returning false if it is missing, damaged or made from
+  // a different source
+  bool open(string file_name, const image_key& key);
+
+  uint64_t get_start_address();
+  uint64_t get_byte_count();
+  uint64_t get_run_count();
+  uint64_t run_address(uint64_t r);
+  uint64_t run_length(uint64_t r);
+  uint64_t get_page_count();
+  uint64_t page_address(uint64_t p);
+  uint64_t* page_data(uint64_t p);  // writable, private to this process
+
+  // Hand the mapping over to the caller (to munmap once done with pages
+  // taken from it), as the host address and length
+  pair<void*, uint64_t> release();
+
+};
+
+#endif
@@ -0,0 +1,689 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Dynamic binary translation of hot blocks to x86-64
+
+**************************************************************** */
+
+#include "jit.h"
+
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Size of the code buffer. When it fills up, all compiled code is thrown
+// away and blocks are compiled again as they get hot.
+static const size_t jit_buffer_size = 16 * 1024 * 1024;
+
+#if defined(__x86_64__)
+
+// Host registers. Native code keeps rbx = guest register array,
+// r12 = processor, r13 = frame and r15 = address of the guest pc.
+enum host_reg {
+  RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+  R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15
+};
+
+// x86 condition codes
+enum host_cond {
+  CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xc, CC_GE = 0xd
+};
+
+// Group 1 ALU operations: opcode of the "r/m, reg" form and /digit of the
+// "r/m, imm32" form
+struct alu_op {
+  uint8_t rr;
+  uint8_t ext;
+};
+static const alu_op ALU_ADD = {0x01, 0};
+static const alu_op ALU_OR = {0x09, 1};
+static const alu_op ALU_AND = {0x21, 4};
+static const alu_op ALU_SUB = {0x29, 5};
+static const alu_op ALU_XOR = {0x31, 6};
+static const alu_op ALU_CMP = {0x39, 7};
+
+// Shift /digit values
+static const int SHIFT_SHL = 4;
+static const int SHIFT_SHR = 5;
+static const int SHIFT_SAR = 7;
+
+// Minimal x86-64 assembler for the instructions the translator needs
+class x86_assembler {
+
+ public:
+  vector<uint8_t> code;
+
+  void byte(uint8_t b) { code.push_back(b); }
+
+  void dword(uint32_t d) {
+    for (int i = 0; i < 4; i++) byte(d >> (8 * i));
+  }
+
+  void qword(uint64_t q) {
+    for (int i = 0; i < 8; i++) byte(q >> (8 * i));
+  }
+
+  void rex(bool w, int reg, int index, int base) {
+    uint8_t r = 0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) |
+                (base >> 3);
+    if (r != 0x40) byte(r);
+  }
+
+  void modrm_rr(int reg, int rm) { byte(0xc0 | (reg & 7) << 3 | (rm & 7)); }
+
+  // [base + disp32]
+  void modrm_mem(int reg, int base, int32_t disp) {
+    byte(0x80 | (reg & 7) << 3 | (base & 7));
+    if ((base & 7) == RSP) byte(0x24);
+    dword(disp);
+  }
+
+  // [base + index + disp32]
+  void modrm_indexed(int reg, int base, int index, int32_t disp) {
+    byte(0x84 | (reg & 7) << 3);
+    byte((index & 7) << 3 | (base & 7));
+    dword(disp);
+  }
+
+  // [base + index], base not rbp/r13
+  void modrm_pair(int reg, int base, int index) {
+    byte(0x04 | (reg & 7) << 3);
+    byte((index & 7) << 3 | (base & 7));
+  }
+
+  void push(int r) {
+    rex(false, 0, 0, r);
+    byte(0x50 | (r & 7));
+  }
+
+  void pop(int r) {
+    rex(false, 0, 0, r);
+    byte(0x58 | (r & 7));
+  }
+
+  void ret() { byte(0xc3); }
+
+  // mov dst, [base + disp]
+  void load(int dst, int base, int32_t disp) {
+    rex(true, dst, 0, base);
+    byte(0x8b);
+    modrm_mem(dst, base, disp);
+  }
+
+  // mov [base + disp], src
+  void store(int base, int32_t disp, int src) {
+    rex(true, src, 0, base);
+    byte(0x89);
+    modrm_mem(src, base, disp);
+  }
+
+  // mov dst, [base + index + disp]
+  void load_indexed(int dst, int base, int index, int32_t disp) {
+    rex(true, dst, index, base);
+    byte(0x8b);
+    modrm_indexed(dst, base, index, disp);
+  }
+
+  // cmp reg, [base + index + disp]
+  void cmp_indexed(int reg, int base, int index, int32_t disp) {
+    rex(true, reg, index, base);
+    byte(0x3b);
+    modrm_indexed(reg, base, index, disp);
+  }
+
+  void mov_rr(bool w, int dst, int src) {
+    rex(w, src, 0, dst);
+    byte(0x89);
+    modrm_rr(src, dst);
+  }
+
+  void mov_imm(int dst, uint64_t imm) {
+    if ((int64_t)imm == (int64_t)(int32_t)imm) {
+      rex(true, 0, 0, dst);
+      byte(0xc7);
+      modrm_rr(0, dst);
+      dword(imm);
+    } else {
+      rex(true, 0, 0, dst);
+      byte(0xb8 | (dst & 7));
+      qword(imm);
+    }
+  }
+
+  void alu_rr(alu_op op, bool w, int dst, int src) {
+    rex(w, src, 0, dst);
+    byte(op.rr);
+    modrm_rr(src, dst);
+  }
+
+  void alu_imm(alu_op op, bool w, int dst, int32_t imm) {
+    rex(w, 0, 0, dst);
+    byte(0x81);
+    modrm_rr(op.ext, dst);
+    dword(imm);
+  }
+
+  void shift_imm(int ext, bool w, int dst, uint8_t count) {
+    rex(w, 0, 0, dst);
+    byte(0xc1);
+    modrm_rr(ext, dst);
+    byte(count);
+  }
+
+  void shift_cl(int ext, bool w, int dst) {
+    rex(w, 0, 0, dst);
+    byte(0xd3);
+    modrm_rr(ext, dst);
+  }
+
+  // movsxd dst, src32
+  void movsxd(int dst, int src) {
+    rex(true, dst, 0, src);
+    byte(0x63);
+    modrm_rr(dst, src);
+  }
+
+  // setcc al; movzx eax, al
+  void set_rax(host_cond cc) {
+    byte(0x0f);
+    byte(0x90 | cc);
+    modrm_rr(0, RAX);
+    byte(0x0f);
+    byte(0xb6);
+    modrm_rr(RAX, RAX);
+  }
+
+  void cmov(host_cond cc, int dst, int src) {
+    rex(true, dst, 0, src);
+    byte(0x0f);
+    byte(0x40 | cc);
+    modrm_rr(dst, src);
+  }
+
+  // test al, imm8
+  void test_al(uint8_t imm) {
+    byte(0xa8);
+    byte(imm);
+  }
+
+  // test eax, eax
+  void test_eax() {
+    byte(0x85);
+    modrm_rr(RAX, RAX);
+  }
+
+  void call_rax() {
+    byte(0xff);
+    modrm_rr(2, RAX);
+  }
+
+  // cmp dword [base + disp], imm
+  void cmp_mem_imm(int base, int32_t disp, uint32_t imm) {
+    rex(false, 0, 0, base);
+    byte(0x81);
+    modrm_mem(7, base, disp);
+    dword(imm);
+  }
+
+  // inc qword [r]
+  void inc_mem(int r) {
+    rex(true, 0, 0, r);
+    byte(0xff);
+    byte(r & 7);
+  }
+
+  // Jumps return the offset of their rel32 field for patch()
+  size_t jcc(host_cond cc) {
+    byte(0x0f);
+    byte(0x80 | cc);
+    dword(0);
+    return code.size() - 4;
+  }
+
+  size_t jmp() {
+    byte(0xe9);
+    dword(0);
+    return code.size() - 4;
+  }
+
+  void patch(size_t at, size_t target) {
+    uint32_t rel = target - (at + 4);
+    memcpy(&code[at], &rel, 4);
+  }
+
+  // Load rax/rcx/... with guest register r
+  void load_guest(int dst, unsigned int r) {
+    if (r == 0) {
+      alu_rr(ALU_XOR, false, dst, dst);
+    } else {
+      load(dst, RBX, 8 * r);
+    }
+  }
+
+  void store_guest(unsigned int r, int src) {
+    if (r != 0) store(RBX, 8 * r, src);
+  }
+};
+
+static const int32_t frame_registers = offsetof(jit_frame, registers);
+static const int32_t frame_pc = offsetof(jit_frame, pc);
+static const int32_t frame_cpu = offsetof(jit_frame, cpu);
+static const int32_t frame_tlb = offsetof(jit_frame, tlb);
+
+// Translates one block. Each RISC-V instruction becomes a short x86
+// sequence working on the register frame; anything without a native
+// translation is run through the interpreter via the step helper.
+class block_compiler {
+
+ private:
+  x86_assembler a;
+  const basic_block* block;
+  jit_step_helper step;
+  vector<size_t> to_epilogue;  // jumps to patch to the shared epilogue
+
+  // mov eax, executed; jmp epilogue
+  void leave(unsigned int executed) {
+    a.byte(0xb8);
+    a.dword(executed);
+    to_epilogue.push_back(a.jmp());
+  }
+
+  // Set the guest pc and leave
+  void leave_at(uint64_t pc, unsigned int executed) {
+    a.mov_imm(RAX, pc);
+    a.store(R15, 0, RAX);
+    leave(executed);
+  }
+
+  // Run entry index in the interpreter; leaves if the helper says so
+  void call_step(unsigned int index) {
+    a.mov_rr(true, RDI, R12);
+    a.mov_imm(RSI, (uint64_t)block);
+    a.byte(0xba);  // mov edx, imm32
+    a.dword(index);
+    a.mov_imm(RAX, (uint64_t)step);
+    a.call_rax();
+    a.test_eax();
+    size_t go_on = a.jcc(CC_E);
+    leave(index + 1);
+    a.patch(go_on, a.code.size());
+  }
+
+  // Compute the effective address into rax, check alignment and look the
+  // page up in the frame's TLB. On a hit, rsi = host page data,
+  // rax = offset in page, rdx = guest page address and rcx = TLB entry
+  // offset. Returns the jumps to the slow path.
+  vector<size_t> address(const decoded_instruction& inst, unsigned int size) {
+    vector<size_t> slow;
+    a.load_guest(RAX, inst.rs1);
+    a.alu_imm(ALU_ADD, true, RAX, (int32_t)inst.imm);
+    if (size > 1) {
+      a.test_al(size - 1);
+      slow.push_back(a.jcc(CC_NE));
+    }
+    a.mov_rr(true, RCX, RAX);
+    a.shift_imm(SHIFT_SHR, true, RCX, 12);
+    a.alu_imm(ALU_AND, false, RCX, jit_tlb_size - 1);
+    a.shift_imm(SHIFT_SHL, false, RCX, 5);  // sizeof(jit_tlb_entry)
+    a.mov_rr(true, RDX, RAX);
+    a.alu_imm(ALU_AND, true, RDX, -4096);
+    a.cmp_indexed(RDX, R13, RCX, frame_tlb);
+    slow.push_back(a.jcc(CC_NE));
+    a.load_indexed(RSI, R13, RCX, frame_tlb + 8);
+    a.alu_imm(ALU_AND, false, RAX, 0xfff);
+    return slow;
+  }
+
+  void load(unsigned int index, const decoded_instruction& inst) {
+    unsigned int size = 1;
+    switch (inst.op) {
+      case OP_LH: case OP_LHU: size = 2; break;
+      case OP_LW: case OP_LWU: size = 4; break;
+      case OP_LD: size = 8; break;
+    }
+    vector<size_t> slow = address(inst, size);
+    switch (inst.op) {
+      case OP_LB:  // movsx rax, byte [rsi + rax]
+        a.byte(0x48); a.byte(0x0f); a.byte(0xbe);
+        break;
+      case OP_LBU:  // movzx eax, byte [rsi + rax]
+        a.byte(0x0f); a.byte(0xb6);
+        break;
+      case OP_LH:  // movsx rax, word [rsi + rax]
+        a.byte(0x48); a.byte(0x0f); a.byte(0xbf);
+        break;
+      case OP_LHU:  // movzx eax, word [rsi + rax]
+        a.byte(0x0f); a.byte(0xb7);
+        break;
+      case OP_LW:  // movsxd rax, dword [rsi + rax]
+        a.byte(0x48); a.byte(0x63);
+        break;
+      case OP_LWU:  // mov eax, dword [rsi + rax]
+        a.byte(0x8b);
+        break;
+      case OP_LD:  // mov rax, qword [rsi + rax]
+        a.byte(0x48); a.byte(0x8b);
+        break;
+    }
+    a.modrm_pair(RAX, RSI, RAX);
+    a.store_guest(inst.rd, RAX);
+    size_t done = a.jmp();
+    for (size_t j : slow) a.patch(j, a.code.size());
+    call_step(index);
+    a.patch(done, a.code.size());
+  }
+
+  void store(unsigned int index, const decoded_instruction& inst,
+             uint64_t pc) {
+    unsigned int size = 1;
+    switch (inst.op) {
+      case OP_SH: size = 2; break;
+      case OP_SW: size = 4; break;
+      case OP_SD: size = 8; break;
+    }
+    vector<size_t> slow = address(inst, size);
+    a.load_indexed(RDI, R13, RCX, frame_tlb + 16);
+    a.load_guest(RCX, inst.rs2);
+    switch (size) {
+      case 1:  // mov byte [rsi + rax], cl
+        a.byte(0x88);
+        break;
+      case 2:  // mov word [rsi + rax], cx
+        a.byte(0x66); a.byte(0x89);
+        break;
+      case 4:  // mov dword [rsi + rax], ecx
+        a.byte(0x89);
+        break;
+      case 8:  // mov qword [rsi + rax], rcx
+        a.byte(0x48); a.byte(0x89);
+        break;
+    }
+    a.modrm_pair(RCX, RSI, RAX);
+    a.inc_mem(RDI);  // new page generation
+    // Leave after a store into the block's own page that changed an
+    // instruction still to run (rsi still points at the page)
+    a.mov_imm(RAX, block->start - block->start % 4096);
+    a.alu_rr(ALU_CMP, true, RDX, RAX);
+    size_t other_page = a.jcc(CC_NE);
+    vector<size_t> changed;
+    for (unsigned int k = index + 1; k < block->entries.size(); k++) {
+      a.cmp_mem_imm(RSI, (block->start + 4 * k) % 4096,
+                    block->entries[k].inst.raw);
+      changed.push_back(a.jcc(CC_NE));
+    }
+    size_t unchanged = a.jmp();
+    for (size_t j : changed) a.patch(j, a.code.size());
+    leave_at(pc + 4, index + 1);
+    a.patch(other_page, a.code.size());
+    a.patch(unchanged, a.code.size());
+    size_t done = a.jmp();
+    for (size_t j : slow) a.patch(j, a.code.size());
+    call_step(index);
+    a.patch(done, a.code.size());
+  }
+
+  // rax = rs1 op rs2 (or imm), result to rd
+  void alu(const decoded_instruction& inst, alu_op op, bool w, bool imm) {
+    a.load_guest(RAX, inst.rs1);
+    if (imm) {
+      a.alu_imm(op, w, RAX, (int32_t)inst.imm);
+    } else {
+      a.load_guest(RCX, inst.rs2);
+      a.alu_rr(op, w, RAX, RCX);
+    }
+    if (!w) a.movsxd(RAX, RAX);
+    a.store_guest(inst.rd, RAX);
+  }
+
+  void shift(const decoded_instruction& inst, int ext, bool w, bool imm) {
+    a.load_guest(RAX, inst.rs1);
+    if (imm) {
+      a.shift_imm(ext, w, RAX, inst.imm);
+    } else {
+      a.load_guest(RCX, inst.rs2);
+      a.shift_cl(ext, w, RAX);
+    }
+    if (!w) a.movsxd(RAX, RAX);
+    a.store_guest(inst.rd, RAX);
+  }
+
+  void compare(const decoded_instruction& inst, bool w, host_cond cc,
+               bool imm) {
+    a.load_guest(RAX, inst.rs1);
+    if (imm) {
+      a.alu_imm(ALU_CMP, w, RAX, (int32_t)inst.imm);
+    } else {
+      a.load_guest(RCX, inst.rs2);
+      a.alu_rr(ALU_CMP, w, RAX, RCX);
+    }
+    a.set_rax(cc);
+    a.store_guest(inst.rd, RAX);
+  }
+
+  void branch(unsigned int index, const decoded_instruction& inst,
+              uint64_t pc, bool w, host_cond cc) {
+    a.load_guest(RAX, inst.rs1);
+    a.load_guest(RCX, inst.rs2);
+    a.mov_imm(RDX, pc + 4);
+    a.mov_imm(RSI, pc + inst.imm);
+    a.alu_rr(ALU_CMP, w, RAX, RCX);
+    a.cmov(cc, RDX, RSI);
+    a.store(R15, 0, RDX);
+    leave(index + 1);
+  }
+
+ public:
+  block_compiler(const basic_block* b, jit_step_helper s) : block(b), step(s) {}
+
+  // Returns false at the first instruction that ended the block
+  bool instruction(unsigned int index) {
+    const decoded_instruction& inst = block->entries[index].inst;
+    uint64_t pc = block->start + 4 * index;
+    switch (inst.op) {
+      case OP_LUI:
+        if (inst.rd != 0) {
+          a.mov_imm(RAX, inst.imm);
+          a.store_guest(inst.rd, RAX);
+        }
+        return true;
+      case OP_AUIPC:
+        if (inst.rd != 0) {
+          a.mov_imm(RAX, pc + inst.imm);
+          a.store_guest(inst.rd, RAX);
+        }
+        return true;
+      case OP_JAL:
+        if (inst.rd != 0) {
+          a.mov_imm(RAX, pc + 4);
+          a.store_guest(inst.rd, RAX);
+        }
+        leave_at(pc + inst.imm, index + 1);
+        return false;
+      case OP_JALR:
+        a.load_guest(RDX, inst.rs1);
+        a.alu_imm(ALU_ADD, true, RDX, (int32_t)inst.imm);
+        a.alu_imm(ALU_AND, true, RDX, -2);
+        if (inst.rd != 0) {
+          a.mov_imm(RAX, pc + 4);
+          a.store_guest(inst.rd, RAX);
+        }
+        a.store(R15, 0, RDX);
+        leave(index + 1);
+        return false;
+      case OP_BEQ: branch(index, inst, pc, true, CC_E); return false;
+      case OP_BNE: branch(index, inst, pc, true, CC_NE); return false;
+      case OP_BLT: branch(index, inst, pc, false, CC_L); return false;
+      case OP_BGE: branch(index, inst, pc, false, CC_GE); return false;
+      case OP_BLTU: branch(index, inst, pc, true, CC_B); return false;
+      case OP_BGEU: branch(index, inst, pc, true, CC_AE); return false;
+      case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU:
+      case OP_LWU: case OP_LD:
+        load(index, inst);
+        return true;
+      case OP_SB: case OP_SH: case OP_SW: case OP_SD:
+        store(index, inst, pc);
+        return true;
+      case OP_FENCE:
+        return true;
+      default:
+        break;
+    }
+    if (inst.rd == 0) {
+      // The remaining operations only write rd
+      switch (inst.op) {
+        case OP_ADDI: case OP_SLTI: case OP_SLTIU: case OP_XORI: case OP_ORI:
+        case OP_ANDI: case OP_SLLI: case OP_SRLI: case OP_SRAI: case OP_ADD:
+        case OP_SUB: case OP_SLL: case OP_SLT: case OP_SLTU: case OP_XOR:
+        case OP_SRL: case OP_SRA: case OP_OR: case OP_AND: case OP_ADDIW:
+        case OP_SLLIW: case OP_SRLIW: case OP_SRAIW: case OP_ADDW:
+        case OP_SUBW: case OP_SLLW: case OP_SRLW: case OP_SRAW:
+          return true;
+      }
+    }
+    switch (inst.op) {
+      case OP_ADDI: alu(inst, ALU_ADD, true, true); return true;
+      case OP_SLTI: compare(inst, false, CC_L, true); return true;
+      case OP_SLTIU: compare(inst, true, CC_B, true); return true;
+      case OP_XORI: alu(inst, ALU_XOR, true, true); return true;
+      case OP_ORI: alu(inst, ALU_OR, true, true); return true;
+      case OP_ANDI: alu(inst, ALU_AND, true, true); return true;
+      case OP_SLLI: shift(inst, SHIFT_SHL, true, true); return true;
+      case OP_SRLI: shift(inst, SHIFT_SHR, true, true); return true;
+      case OP_SRAI: shift(inst, SHIFT_SAR, true, true); return true;
+      case OP_ADD: alu(inst, ALU_ADD, true, false); return true;
+      case OP_SUB: alu(inst, ALU_SUB, true, false); return true;
+      case OP_SLL: shift(inst, SHIFT_SHL, true, false); return true;
+      case OP_SLT: compare(inst, false, CC_L, false); return true;
+      case OP_SLTU: compare(inst, true, CC_B, false); return true;
+      case OP_XOR: alu(inst, ALU_XOR, true, false); return true;
+      case OP_SRL: shift(inst, SHIFT_SHR, true, false); return true;
+      case OP_SRA: shift(inst, SHIFT_SAR, true, false); return true;
+      case OP_OR: alu(inst, ALU_OR, true, false); return true;
+      case OP_AND: alu(inst, ALU_AND, true, false); return true;
+      case OP_ADDIW: alu(inst, ALU_ADD, false, true); return true;
+      case OP_SLLIW: shift(inst, SHIFT_SHL, false, true); return true;
+      case OP_SRLIW: shift(inst, SHIFT_SHR, false, true); return true;
+      case OP_SRAIW: shift(inst, SHIFT_SAR, false, true); return true;
+      case OP_ADDW: alu(inst, ALU_ADD, false, false); return true;
+      case OP_SUBW: alu(inst, ALU_SUB, false, false); return true;
+      case OP_SLLW: shift(inst, SHIFT_SHL, false, false); return true;
+      case OP_SRLW: shift(inst, SHIFT_SHR, false, false); return true;
+      case OP_SRAW: shift(inst, SHIFT_SAR, false, false); return true;
+      default:
+        // Illegal, Zicsr and privileged instructions end the block and are
+        // left to the interpreter.
+        call_step(index);
+        leave(index + 1);
+        return false;
+    }
+  }
+
+  vector<uint8_t>& assemble() {
+    a.push(RBX);
+    a.push(R12);
+    a.push(R13);
+    a.push(R14);
+    a.push(R15);
+    a.mov_rr(true, R13, RDI);
+    a.load(RBX, R13, frame_registers);
+    a.load(R15, R13, frame_pc);
+    a.load(R12, R13, frame_cpu);
+
+    unsigned int count = block->entries.size();
+    unsigned int index = 0;
+    while (index < count && instruction(index)) {
+      index++;
+    }
+    if (index == count) {  // ran off the end of the block
+      leave_at(block->start + 4 * count, count);
+    }
+
+    size_t epilogue = a.code.size();
+    for (size_t j : to_epilogue) a.patch(j, epilogue);
+    a.pop(R15);
+    a.pop(R14);
+    a.pop(R13);
+    a.pop(R12);
+    a.pop(RBX);
+    a.ret();
+    return a.code;
+  }
+};
+
+// Constructor. The buffer is never writable and executable at once: it is
+// mapped read/write, and compile() makes the pages it fills executable.
+// Hosts that refuse to make such pages executable get no JIT.
+jit::jit() {
+  used = 0;
+  capacity = jit_buffer_size;
+  void* mapped = mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED) {
+    buffer = nullptr;
+    capacity = 0;
+  } else if (mprotect(mapped, sysconf(_SC_PAGESIZE),
+                      PROT_READ | PROT_EXEC) != 0) {
+    munmap(mapped, capacity);
+    buffer = nullptr;
+    capacity = 0;
+  } else {
+    buffer = (uint8_t*)mapped;
+  }
+}
+
+jit::~jit() {
+  if (buffer != nullptr) munmap(buffer, capacity);
+}
+
+bool jit::available() { return buffer != nullptr; }
+
+native_block jit::compile(const basic_block* block, jit_step_helper step) {
+  if (buffer == nullptr) return nullptr;
+  block_compiler compiler(block, step);
+  vector<uint8_t>& code = compiler.assemble();
+  if (used + code.size() > capacity) return nullptr;
+  uint8_t* entry = buffer + used;
+  // The first page may hold earlier blocks; none of them runs while it is
+  // writable, as compiling happens between blocks
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  uint8_t* first = buffer + used / page_size * page_size;
+  size_t length = entry + code.size() - first;
+  if (mprotect(first, length, PROT_READ | PROT_WRITE) != 0) return nullptr;
+  memcpy(entry, &code[0], code.size());
+  if (mprotect(first, length, PROT_READ | PROT_EXEC) != 0) return nullptr;
+  used += (code.size() + 15) & ~(size_t)15;
+  return (native_block)entry;
+}
+
+#else  // no native code generation on this host
+
+jit::jit() {
+  buffer = nullptr;
+  capacity = 0;
+  used = 0;
+}
+
+jit::~jit() {}
+
+bool jit::available() { return false; }
+
+native_block jit::compile(const basic_block* block, jit_step_helper step) {
+  return nullptr;
+}
+
+#endif
+
+void jit::reset() { used = 0; }
+
+void jit::flush_tlb(jit_frame& frame) {
+  for (unsigned int i = 0; i < jit_tlb_size; i++) {
+    frame.tlb[i].tag = 1;  // never a page address
+  }
+}
@@ -0,0 +1,76 @@
+#ifndef JIT_H
+#define JIT_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Dynamic binary translation of hot blocks to x86-64
+
+**************************************************************** */
+
+#include <cstddef>
+#include <cstdint>
+
+#include "block.h"
+
+using namespace std;
+
+// An entry of the memory translation cache used by native loads and
+// stores: guest page address to the host copy of that page.
+struct jit_tlb_entry {
+  uint64_t tag;          // guest page address, or 1 when empty
+  uint64_t* data;        // the page's 512 doublewords
+  uint64_t* generation;  // the page's write generation
+  uint64_t unused;
+};
+
+static const unsigned int jit_tlb_size = 64;
+
+// Called from native code to run entry index of block in the interpreter,
+// with pc set to that instruction. Returns nonzero if the block must stop
+// after it (it trapped or wrote to the block's own page).
+typedef unsigned int (*jit_step_helper)(void* cpu, const basic_block* block,
+                                        unsigned int index);
+
+// Fixed frame shared by the processor and native code. Guest registers
+// live in the processor's register array and are addressed through it.
+struct jit_frame {
+  uint64_t* registers;  // guest x0..x31
+  uint64_t* pc;         // guest pc
+  void* cpu;            // handed back to the step helper
+  const basic_block* block;  // block being run
+  jit_step_helper step;      // for code not bound to a processor (AOT)
+  jit_tlb_entry tlb[jit_tlb_size];
+};
+
+class jit {
+
+ private:
+  uint8_t* buffer;  // mmap'd code buffer, never writable and executable
+  size_t capacity;
+  size_t used;
+
+ public:
+
+  // Constructor
+  jit();
+  ~jit();
+
+  // True if native code can be generated and run on this host
+  bool available();
+
+  // Compile a block. Instructions without a native translation call step.
+  // Returns nullptr if the code buffer is full (or its pages cannot change
+  // protection).
+  native_block compile(const basic_block* block, jit_step_helper step);
+
+  // Discard all compiled code
+  void reset();
+
+  // Empty the memory translation cache of a frame
+  static void flush_tlb(jit_frame& frame);
+
+};
+
+#endif
@@ -0,0 +1,105 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Benchmark of loading a large hex file with 1, 2, 4 ... threads, up
+   to the number of hardware threads (at least 8). The file is made of
+   random data, 32 bytes per record, in the temporary directory.
+
+**************************************************************** */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "memory.h"
+
+using namespace std;
+
+static const unsigned int runs = 3;  // best of
+
+// Write megabytes of data as 32-byte data records, with an extended
+// linear address record every 64Kbytes
+static void make_file(string file_name, unsigned int megabytes) {
+  ofstream output(file_name);
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  char line[80];
+  for (unsigned int segment = 0; segment < 16 * megabytes; segment++) {
+    unsigned int high = 0x100 + segment;
+    unsigned int sum = 2 + 4 + (high >> 8) + (high & 0xff);
+    snprintf(line, sizeof(line), ":02000004%04X%02X\n", high, -sum & 0xff);
+    output << line;
+    for (unsigned int address = 0; address < 0x10000; address += 32) {
+      int n = snprintf(line, sizeof(line), ":20%04X00", address);
+      sum = 0x20 + (address >> 8) + (address & 0xff);
+      for (unsigned int i = 0; i < 32; i++) {
+        state ^= state << 13;  // xorshift64
+        state ^= state >> 7;
+        state ^= state << 17;
+        unsigned int byte = state & 0xff;
+        n += snprintf(line + n, sizeof(line) - n, "%02X", byte);
+        sum += byte;
+      }
+      snprintf(line + n, sizeof(line) - n, "%02X\n", -sum & 0xff);
+      output << line;
+    }
+  }
+  output << ":00000001FF\n";
+}
+
+// Seconds to load the file into an empty memory
+static double time_load(string file_name, unsigned int threads) {
+  double best = 0;
+  for (unsigned int r = 0; r < runs; r++) {
+    memory store(false);
+    store.set_image_cache(false);
+    store.set_load_threads(threads);
+    uint64_t start_address;
+    streambuf* output = cout.rdbuf(nullptr);  // the load message
+    auto start = chrono::steady_clock::now();
+    store.load_file(file_name, start_address);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout.rdbuf(output);
+    if (r == 0 || elapsed.count() < best) {
+      best = elapsed.count();
+    }
+  }
+  return best;
+}
+
+int main(int argc, char* argv[]) {
+  unsigned int megabytes = argc > 1 ? stoi(argv[1]) : 64;
+  const char* directory = getenv("TMPDIR");
+  string file_name = string(directory ? directory : "/tmp") +
+                     "/loadbench-" + to_string(getpid()) + ".hex";
+  make_file(file_name, megabytes);
+  ifstream sized(file_name, ios::ate);
+  double file_megabytes = sized.tellg() / 1e6;
+
+  unsigned int most = max(8u, thread::hardware_concurrency());
+  cout << megabytes << " Mbytes of data, " << fixed << setprecision(1)
+       << file_megabytes << " Mbytes of hex, " << thread::hardware_concurrency()
+       << " hardware threads" << endl;
+  cout << "threads   seconds      MB/s   speedup" << endl;
+  double single = 0;
+  for (unsigned int threads = 1; threads <= most; threads *= 2) {
+    double seconds = time_load(file_name, threads);
+    if (threads == 1) {
+      single = seconds;
+    }
+    cout << setfill(' ') << setw(7) << threads << setw(10)
+         << setprecision(3) << seconds
+         << setw(10) << setprecision(1) << file_megabytes / seconds
+         << setw(10) << setprecision(2) << single / seconds << endl;
+  }
+  remove(file_name.c_str());
+  return 0;
+}
@@ -0,0 +1,67 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Class members for mapped_file
+
+**************************************************************** */
+
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Constructor
+mapped_file::mapped_file() {
+  mapping = nullptr;
+  length = 0;
+  modified = 0;
+}
+
+mapped_file::~mapped_file() {
+  if (mapping != nullptr) {
+    munmap(mapping, length);
+  }
+}
+
+bool mapped_file::open(string file_name) {
+  int fd = ::open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat status;
+  bool regular = fstat(fd, &status) == 0 && S_ISREG(status.st_mode);
+  if (regular) {
+    modified = status.st_mtim.tv_sec * 1000000000ULL + status.st_mtim.tv_nsec;
+  }
+  if (regular && status.st_size > 0) {
+    void* mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      madvise(mapped, status.st_size, MADV_SEQUENTIAL);
+      mapping = mapped;
+      length = status.st_size;
+      close(fd);
+      return true;
+    }
+  }
+  char buffer[65536];
+  ssize_t got;
+  while ((got = read(fd, buffer, sizeof(buffer))) > 0) {
+    contents.insert(contents.end(), buffer, buffer + got);
+  }
+  close(fd);
+  length = contents.size();
+  return got == 0;
+}
+
+const char* mapped_file::data() {
+  return mapping != nullptr ? (const char*)mapping : contents.data();
+}
+
+uint64_t mapped_file::size() { return length; }
+
+uint64_t mapped_file::modification_time() { return modified; }
@@ -0,0 +1,46 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Read-only view of a whole file
+
+**************************************************************** */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The contents of a file, mapped into memory. A file that cannot be mapped
+// (a pipe, say) is read into a buffer instead. Unmapped when destroyed.
+class mapped_file {
+
+ private:
+  void* mapping;        // null if the file was read into contents
+  uint64_t length;
+  uint64_t modified;    // modification time in nanoseconds, 0 if unknown
+  vector<char> contents;
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+ public:
+
+  // Constructor
+  mapped_file();
+  ~mapped_file();
+
+  // Map the file, returning false if it cannot be opened or read
+  bool open(string file_name);
+
+  const char* data();
+  uint64_t size();
+  uint64_t modification_time();
+
+};
+
+#endif
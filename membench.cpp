@@ -0,0 +1,140 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Microbenchmark of the page store: the radix page table used by memory
+   against the hashed store it replaced, on sequential, strided and
+   random doubleword accesses
+
+**************************************************************** */
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "page_table.h"
+
+using namespace std;
+
+// The previous store: pages in a hash map keyed by page address
+class hashed_store {
+
+ private:
+  struct hashed_page {
+    vector<uint64_t> data;
+    uint64_t generation;
+  };
+  unordered_map<uint64_t, hashed_page> store;
+
+ public:
+  hashed_page* validate(uint64_t address) {
+    uint64_t page_address = address - address % 4096;
+    auto found = store.find(page_address);
+    if (found == store.end()) {
+      hashed_page& allocated = store[page_address];
+      allocated.data = vector<uint64_t>(512);
+      allocated.generation = 0;
+      return &allocated;
+    }
+    return &found->second;
+  }
+
+  uint64_t read_doubleword(uint64_t address) {
+    return validate(address)->data[(address % 4096) / 8];
+  }
+
+  void write_doubleword(uint64_t address, uint64_t data) {
+    hashed_page* p = validate(address);
+    p->data[(address % 4096) / 8] = data;
+    p->generation++;
+  }
+
+};
+
+// The radix page table, accessed the way memory does
+class radix_store {
+
+ private:
+  page_table store;
+
+ public:
+  page* validate(uint64_t address) {
+    page* p = store.find(address);
+    return p != nullptr ? p : store.allocate(address);
+  }
+
+  uint64_t read_doubleword(uint64_t address) {
+    return validate(address)->data[(address % 4096) / 8];
+  }
+
+  void write_doubleword(uint64_t address, uint64_t data) {
+    page* p = validate(address);
+    p->data[(address % 4096) / 8] = data;
+    p->generation++;
+  }
+
+};
+
+static const uint64_t region_base = 0x80000000ULL;
+static const uint64_t region_size = 64ULL << 20;  // 64Mbytes, 16K pages
+static const unsigned int accesses = 1 << 24;
+
+// Addresses of each access pattern, all within the region
+void make_addresses(string pattern, vector<uint64_t>& addresses) {
+  addresses.resize(accesses);
+  uint64_t state = 0x2545f4914f6cdd1dULL;
+  for (unsigned int i = 0; i < accesses; i++) {
+    uint64_t offset;
+    if (pattern == "sequential") {
+      offset = 8ULL * i;
+    } else if (pattern == "strided") {
+      offset = (4096ULL + 8) * i;  // a new page every access
+    } else {
+      state ^= state << 13;  // xorshift64
+      state ^= state >> 7;
+      state ^= state << 17;
+      offset = state;
+    }
+    addresses[i] = region_base + offset % region_size - offset % 8;
+  }
+}
+
+// Time a write then a read of every address, in ns per access
+template <class store_type>
+double run_pattern(const vector<uint64_t>& addresses, uint64_t& checksum) {
+  store_type store;
+  for (uint64_t a = region_base; a < region_base + region_size; a += 4096) {
+    store.validate(a);  // time hits, not allocation
+  }
+  auto start = chrono::steady_clock::now();
+  for (unsigned int i = 0; i < accesses; i++) {
+    store.write_doubleword(addresses[i], i);
+  }
+  for (unsigned int i = 0; i < accesses; i++) {
+    checksum += store.read_doubleword(addresses[i]);
+  }
+  chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+  return elapsed.count() / (2.0 * accesses);
+}
+
+int main() {
+  const char* patterns[] = {"sequential", "strided", "random"};
+  uint64_t checksum = 0;
+  vector<uint64_t> addresses;
+
+  cout << "ns per access   " << setw(10) << "hashed" << setw(10) << "radix"
+       << endl;
+  for (const char* pattern : patterns) {
+    make_addresses(pattern, addresses);
+    double hashed = run_pattern<hashed_store>(addresses, checksum);
+    double radix = run_pattern<radix_store>(addresses, checksum);
+    cout << left << setw(16) << pattern << right << fixed << setprecision(2)
+         << setw(10) << hashed << setw(10) << radix << endl;
+  }
+  cout << "checksum " << hex << checksum << endl;
+  return 0;
+}
@@ -8,159 +8,1122 @@
 
 #include "memory.h"
 
+#include <fcntl.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#include <cstdio>
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <thread>
+
+#include "hex_chunk.h"
+#include "mapped_file.h"
 using namespace std;
 
+const unsigned int memory::WATCH_WRITE;
+const unsigned int memory::WATCH_READ;
+
 // Constructor
-memory::memory(bool verbose) {
+memory::memory(bool verbose) : zeros(), zero_page() {
   if (verbose == true) {
     cout << "Memory Initialised" << endl;
   }
   is_verbose = verbose;
+  journaling = false;
+  watch_hit = false;
+  zero_page.data = zeros;
+  base_snapshot = -1;
+  restored_pages = 0;
+  device_pages = 0;
+  load_threads = max(1u, thread::hardware_concurrency());
+  use_image_cache = true;
 }
 
-void memory::validate(uint64_t address) {
-  uint64_t page_address = (address - address % 4096);
+memory::~memory() {
+  for (auto& r : regions) {
+    munmap(r.host, r.size);
+  }
+  for (auto& m : file_mappings) {
+    munmap(m.first, m.second);
+  }
+}
 
-  if (store.find(page_address) == store.end()) {
-    store[page_address] = vector<uint64_t>(512);
-    /*
-    if (is_verbose) {
-      cout << "Allocated memory for page at address: " << page_address << endl;
+bool memory::add_region(uint64_t base, uint64_t size, bool huge_pages) {
+  if (base % 4096 != 0 || size % 4096 != 0 || size == 0 ||
+      base + size - 1 < base) {
+    return false;
+  }
+  for (auto& r : regions) {
+    if (base < r.base + r.size && r.base < base + size) {
+      return false;
     }
-    */
-  }/* else{
-    if(is_verbose){
-      cout << "Memory has already been allocated at page address: " << page_address << endl; 
+  }
+  for (auto& d : devices) {
+    if (base < d->base + d->size && d->base < base + size) {
+      return false;
     }
   }
-  */
-  return;
+  void* host = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (host == MAP_FAILED) {
+    return false;
+  }
+#ifdef MADV_HUGEPAGE
+  if (huge_pages) {
+    madvise(host, size, MADV_HUGEPAGE);
+  }
+#endif
+  ram_region region;
+  region.base = base;
+  region.size = size;
+  region.host = (uint64_t*)host;
+  regions.push_back(region);
+  return true;
+}
+
+bool memory::attach_device(uint64_t base, uint64_t size, device* handler) {
+  if (base % 4096 != 0 || size % 4096 != 0 || size == 0 ||
+      base + size - 1 < base) {
+    return false;
+  }
+  for (auto& r : regions) {
+    if (base < r.base + r.size && r.base < base + size) {
+      return false;
+    }
+  }
+  for (uint64_t a = base; a < base + size; a += 4096) {
+    if (store.find(a) != nullptr) {
+      return false;  // in use as RAM, or by another device
+    }
+  }
+  mmio_region* region = new mmio_region();
+  region->base = base;
+  region->size = size;
+  region->handler = handler;
+  devices.push_back(unique_ptr<mmio_region>(region));
+  for (uint64_t a = base; a < base + size; a += 4096) {
+    store.allocate(a, zeros)->io = region;
+    device_pages++;
+  }
+  return true;
+}
+
+void memory::flush_devices() {
+  for (auto& d : devices) {
+    d->handler->flush();
+  }
+}
+
+// A write to a device page. Bytes not in mask are left out: a partial
+// doubleword is written a byte at a time.
+void memory::device_write(const page* p, uint64_t address, uint64_t data,
+                          uint64_t mask) {
+  device* handler = p->io->handler;
+  uint64_t offset = address - p->io->base;
+  if (mask == ~0ULL) {
+    handler->write(offset, data, 8);
+    return;
+  }
+  for (unsigned int b = 0; b < 8; b++) {
+    if ((mask >> (8 * b)) & 0xff) {
+      handler->write(offset + b, (data >> (8 * b)) & 0xff, 1);
+    }
+  }
+}
+
+// The host data for the page holding address if it is in a RAM region, or
+// nullptr for the sparse store
+uint64_t* memory::region_data(uint64_t address) {
+  for (auto& r : regions) {
+    if (address - r.base < r.size) {
+      return r.host + (address - r.base) / 4096 * 512;
+    }
+  }
+  return nullptr;
 }
+
+page* memory::validate(uint64_t address) {
+  page* p = store.find(address);
+  if (p == nullptr) {
+    p = store.allocate(address, region_data(address));
+  }
+  return p;
+}
+
+// The page holding address, ready to be written
+page* memory::writable(uint64_t address) {
+  page* p = validate(address);
+  if (p->io == nullptr) {
+    touch(p, address);  // device pages are not in snapshots
+  }
+  return p;
+}
+
+// Pages that have never been written are read from the shared zero page,
+// so reading memory never allocates it. Such a page is marked in store the
+// first time, which counts it once and spares later reads the region
+// lookup (regions are all declared before memory is used). A page of a RAM
+// region costs no more than its descriptor, so it is entered on first read.
+const page* memory::readable(uint64_t address) {
+  bool read;
+  page* p = store.find(address, read);
+  if (read) {
+    return &zero_page;
+  }
+  if (p == nullptr) {
+    uint64_t* data = region_data(address);
+    if (data != nullptr) {
+      return store.allocate(address, data);
+    }
+    store.mark_read(address);
+    return &zero_page;
+  }
+  return p;
+}
+
+page* memory::find_page(uint64_t address) { return store.find(address); }
+
+// FNV-1a, a doubleword at a time, over the pages in address order
+uint64_t memory::content_hash() {
+  vector<pair<uint64_t, page*>> pages;
+  store.pages(pages);
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (auto& p : pages) {
+    if (p.second->io != nullptr) {
+      continue;
+    }
+    hash = (hash ^ p.first) * 0x100000001b3ULL;
+    for (unsigned int i = 0; i < 512; i++) {
+      hash = (hash ^ p.second->data[i]) * 0x100000001b3ULL;
+    }
+  }
+  return hash;
+}
+
+page* memory::code_page(uint64_t address) {
+  page* p = validate(address);
+  if (!p->code) {
+    p->code.reset(new predecoded_page());
+  }
+  return p;
+}
+
 // Read a doubleword of data from a doubleword-aligned address.
 // If the address is not a multiple of 8, it is rounded down to a multiple of 8.
 uint64_t memory::read_doubleword(uint64_t address) { 
-  uint64_t page_address = (address - address % 4096);
-  uint64_t aligned_address = (address - address % 8);
-  validate(aligned_address);
-  return store[page_address][(aligned_address-page_address)/8]; 
+  const page* p = readable(address);
+  if (p->watches != 0) {
+    check_watch(address, WATCH_READ);
+  }
+  if (p->io != nullptr) {
+    return p->io->handler->read(address - address % 8 - p->io->base, 8);
+  }
+  return p->data[(address % 4096) / 8];
   }
 
 // Write a doubleword of data to a doubleword-aligned address.
 // If the address is not a multiple of 8, it is rounded down to a multiple of 8.
 // The mask contains 1s for bytes to be updated and 0s for bytes that are to be
 // unchanged.
+// Any write moves the page to a new generation, which invalidates
+// instructions predecoded from it.
 void memory::write_doubleword(uint64_t address, uint64_t data, uint64_t mask) {
-  uint64_t page_address = (address - address % 4096);
-  uint64_t aligned_address = (address - address % 8);
-  validate(aligned_address);
-  uint64_t current_val = store[page_address][(aligned_address-page_address)/8];
-  store[page_address][(aligned_address-page_address)/8] = (current_val & ~mask) | (data & mask); 
+  page* p = writable(address);
+  if (p->watches != 0) {
+    check_watch(address, WATCH_WRITE);
+  }
+  if (p->io != nullptr) {
+    device_write(p, address - address % 8, data, mask);
+    return;
+  }
+  uint64_t& current_val = p->data[(address % 4096) / 8];
+  if (journaling) {
+    journal.push_back(make_pair(address - address % 8, current_val));
+  }
+  current_val = (current_val & ~mask) | (data & mask);
+  p->generation++;
   return;
 }
 
+template <typename T>
+T memory::read(uint64_t address) {
+  const page* p = readable(address);
+  if (p->watches != 0) {
+    check_watch(address, WATCH_READ);
+  }
+  if (p->io != nullptr) {
+    return p->io->handler->read(address - p->io->base, sizeof(T));
+  }
+  T data;
+  memcpy(&data, (uint8_t*)p->data + address % 4096, sizeof(T));
+  return data;
+}
+
+template <typename T>
+void memory::write(uint64_t address, T data) {
+  page* p = writable(address);
+  if (p->watches != 0) {
+    check_watch(address, WATCH_WRITE);
+  }
+  if (p->io != nullptr) {
+    p->io->handler->write(address - p->io->base, data, sizeof(T));
+    return;
+  }
+  if (journaling) {
+    journal.push_back(make_pair(address - address % 8,
+                                p->data[(address % 4096) / 8]));
+  }
+  memcpy((uint8_t*)p->data + address % 4096, &data, sizeof(T));
+  p->generation++;
+}
+
+template uint8_t memory::read<uint8_t>(uint64_t);
+template uint16_t memory::read<uint16_t>(uint64_t);
+template uint32_t memory::read<uint32_t>(uint64_t);
+template uint64_t memory::read<uint64_t>(uint64_t);
+template void memory::write<uint8_t>(uint64_t, uint8_t);
+template void memory::write<uint16_t>(uint64_t, uint16_t);
+template void memory::write<uint32_t>(uint64_t, uint32_t);
+template void memory::write<uint64_t>(uint64_t, uint64_t);
+
+// Copy a page at a time. Watched or journaled pages go a doubleword at a
+// time, so that every doubleword touched is checked or recorded, and
+// device pages a byte at a time.
+void memory::read_block(uint64_t address, uint8_t* data, uint64_t length) {
+  while (length > 0) {
+    uint64_t offset = address % 4096;
+    uint64_t chunk = min(length, 4096 - offset);
+    const page* p = readable(address);
+    if (p->watches != 0) {
+      for (uint64_t d = address - address % 8; d < address + chunk; d += 8) {
+        check_watch(d, WATCH_READ);
+      }
+    }
+    if (p->io != nullptr) {
+      for (uint64_t b = 0; b < chunk; b++) {
+        data[b] = p->io->handler->read(address + b - p->io->base, 1);
+      }
+    } else {
+      memcpy(data, (uint8_t*)p->data + offset, chunk);
+    }
+    address += chunk;
+    data += chunk;
+    length -= chunk;
+  }
+}
+
+void memory::write_block(uint64_t address, const uint8_t* data,
+                         uint64_t length) {
+  while (length > 0) {
+    uint64_t offset = address % 4096;
+    uint64_t chunk = min(length, 4096 - offset);
+    page* p = writable(address);
+    if (p->io != nullptr) {
+      for (uint64_t b = 0; b < chunk; b++) {
+        p->io->handler->write(address + b - p->io->base, data[b], 1);
+      }
+      address += chunk;
+      data += chunk;
+      length -= chunk;
+      continue;
+    }
+    if (p->watches != 0 || journaling) {
+      for (uint64_t d = address - address % 8; d < address + chunk; d += 8) {
+        if (p->watches != 0) {
+          check_watch(d, WATCH_WRITE);
+        }
+        if (journaling) {
+          journal.push_back(make_pair(d, p->data[(d % 4096) / 8]));
+        }
+      }
+    }
+    memcpy((uint8_t*)p->data + offset, data, chunk);
+    p->generation++;
+    address += chunk;
+    data += chunk;
+    length -= chunk;
+  }
+}
+
+uint64_t memory::get_allocated_pages() { return store.size() - device_pages; }
+
+uint64_t memory::get_read_only_pages() { return store.read_size(); }
+
+// First access to a page since the last snapshot or restore: give any
+// snapshot sharing its data a copy, and list it as dirty
+void memory::track(page* p, uint64_t address) {
+  if (p->shared != nullptr) {
+    p->shared->copy.reset(new uint64_t[512]);
+    memcpy(p->shared->copy.get(), p->data, 4096);
+    p->shared->data = p->shared->copy.get();
+    p->shared = nullptr;
+  }
+  p->dirty = true;
+  dirty_pages.push_back(address - address % 4096);
+}
+
+unsigned int memory::snapshot() {
+  unsigned int id = snapshots.size();
+  snapshots.push_back(unique_ptr<memory_snapshot>(new memory_snapshot()));
+  memory_snapshot& s = *snapshots.back();
+  s.parent = base_snapshot;
+  vector<uint64_t> changed;
+  if (base_snapshot < 0) {  // every page differs from empty store
+    vector<pair<uint64_t, page*>> pages;
+    store.pages(pages);
+    for (auto& p : pages) {
+      if (p.second->io == nullptr) {
+        changed.push_back(p.first);
+      }
+    }
+  } else {
+    changed.swap(dirty_pages);
+  }
+  for (uint64_t address : changed) {
+    page* p = store.find(address);
+    snapshot_page& saved = s.pages[address];
+    saved.data = p->data;
+    p->shared = &saved;
+    p->dirty = false;
+  }
+  dirty_pages.clear();
+  base_snapshot = id;
+  return id;
+}
+
+// Contents of the page holding address in snapshot id, or nullptr if the
+// page did not exist then
+const uint64_t* memory::snapshot_data(int id, uint64_t address) {
+  for (; id >= 0; id = snapshots[id]->parent) {
+    auto found = snapshots[id]->pages.find(address);
+    if (found != snapshots[id]->pages.end()) {
+      return found->second.data;
+    }
+  }
+  return nullptr;
+}
+
+// The pages that may differ are those dirty since the base snapshot, and
+// those in the snapshots between the base or the target and their closest
+// common ancestor. Going back to the base snapshot itself, as a reset to a
+// baseline does, needs only the dirty pages.
+bool memory::restore(unsigned int id) {
+  if (id >= snapshots.size()) {
+    return false;
+  }
+  vector<uint64_t> changed;
+  if ((int)id == base_snapshot) {
+    changed.swap(dirty_pages);
+  } else {
+    unordered_set<int> target_ancestors;
+    for (int s = id; s >= 0; s = snapshots[s]->parent) {
+      target_ancestors.insert(s);
+    }
+    int common = base_snapshot;
+    while (common >= 0 && target_ancestors.count(common) == 0) {
+      common = snapshots[common]->parent;
+    }
+    unordered_set<uint64_t> pages(dirty_pages.begin(), dirty_pages.end());
+    for (int s = base_snapshot; s != common; s = snapshots[s]->parent) {
+      for (auto& p : snapshots[s]->pages) {
+        pages.insert(p.first);
+      }
+    }
+    for (int s = id; s != common; s = snapshots[s]->parent) {
+      for (auto& p : snapshots[s]->pages) {
+        pages.insert(p.first);
+      }
+    }
+    changed.assign(pages.begin(), pages.end());
+  }
+
+  for (uint64_t address : changed) {
+    page* p = store.find(address);
+    if (p == nullptr) {
+      continue;  // still empty, as it was in any snapshot
+    }
+    if (p->shared != nullptr) {
+      p->dirty = false;
+      track(p, address);  // copy out before overwriting
+    }
+    const uint64_t* data = snapshot_data(id, address);
+    memcpy(p->data, data != nullptr ? data : zeros, 4096);
+    p->generation++;
+    p->dirty = false;
+    restored_pages++;
+  }
+  dirty_pages.clear();
+  base_snapshot = id;
+  return true;
+}
+
+uint64_t memory::get_restored_pages() { return restored_pages; }
+
+void memory::begin_journal() {
+  journal.clear();
+  journaling = true;
+}
+
+void memory::end_journal(vector<pair<uint64_t, uint64_t>>& writes) {
+  journaling = false;
+  writes.swap(journal);
+}
+
+void memory::add_watchpoint(uint64_t address, unsigned int kinds) {
+  uint64_t doubleword = address - address % 8;
+  if (watchpoints.count(doubleword) == 0) {
+    validate(doubleword)->watches++;
+  }
+  watchpoints[doubleword] = kinds;
+}
+
+bool memory::remove_watchpoint(uint64_t address) {
+  uint64_t doubleword = address - address % 8;
+  if (watchpoints.erase(doubleword) == 0) {
+    return false;
+  }
+  validate(doubleword)->watches--;
+  return true;
+}
+
+void memory::clear_watchpoints() {
+  for (auto& w : watchpoints) {
+    validate(w.first)->watches--;
+  }
+  watchpoints.clear();
+  watch_hit = false;
+}
+
+bool memory::watching() { return !watchpoints.empty(); }
+
+// Record an access to a page holding a watch if the doubleword is watched
+// for it. Only the first hit is kept until it is taken.
+void memory::check_watch(uint64_t address, unsigned int kind) {
+  auto found = watchpoints.find(address - address % 8);
+  if (found != watchpoints.end() && (found->second & kind) && !watch_hit) {
+    watch_hit = true;
+    watch_hit_address = found->first;
+    watch_hit_kind = kind;
+  }
+}
+
+bool memory::take_watch_hit(uint64_t& address, unsigned int& kind) {
+  if (!watch_hit) {
+    return false;
+  }
+  watch_hit = false;
+  address = watch_hit_address;
+  kind = watch_hit_kind;
+  return true;
+}
+
+// Run work(i) for each i below count, on up to threads threads (this one
+// included) taking the next i as they finish
+static void parallel_for(unsigned int count, unsigned int threads,
+                         const function<void(unsigned int)>& work) {
+  atomic<unsigned int> next(0);
+  auto worker = [&]() {
+    for (unsigned int i = next++; i < count; i = next++) {
+      work(i);
+    }
+  };
+  vector<thread> pool;
+  for (unsigned int t = 1; t < min(threads, count); t++) {
+    pool.push_back(thread(worker));
+  }
+  worker();
+  for (thread& t : pool) {
+    t.join();
+  }
+}
+
+// Call piece(page address, offset in the page, offset in the data, length)
+// for each part of length bytes at address that lies in one page
+template <typename F>
+static void for_each_page(uint64_t address, uint64_t length, F piece) {
+  uint64_t done = 0;
+  while (done < length) {
+    uint64_t offset = (address + done) % 4096;
+    uint64_t chunk = min(length - done, 4096 - offset);
+    piece(address + done - offset, offset, done, chunk);
+    done += chunk;
+  }
+}
+
+// A page written by a parallel load: the chunk that writes it (-1 if more
+// than one does), and whether that chunk's worker may copy into it itself
+struct load_page {
+  page* p;
+  int owner;
+  bool direct;
+};
+
 // Load a hex image file and provide the start address for execution from the
 // file in start_address. Return true if the file was read without error, or
-// false otherwise.
+// false otherwise. The file is mapped and decoded a record at a time, or a
+// chunk per worker when it is large. A data record is one write_block.
 bool memory::load_file(string file_name, uint64_t &start_address) {
-  ifstream input_file(file_name);
-  string input;
+  auto start = chrono::steady_clock::now();
+  mapped_file input;
+  if (!input.open(file_name)) {
+    cout << "Failed to open file" << endl;
+    return false;
+  }
+  if (elf_file::is_elf(input.data(), input.size())) {
+    return load_elf(file_name, input.data(), input.size(), start_address);
+  }
+  unique_ptr<image_cache> built;  // the cache, made while loading
+  image_key key;
+  if (use_image_cache && input.modification_time() != 0) {  // a regular file
+    key = image_cache::key_of(input.data(), input.size(),
+                              input.modification_time());
+    image_cache cached;
+    if (cached.open(image_cache::sidecar_name(file_name), key)) {
+      uint64_t mapped_pages = load_image(cached);
+      start_address = cached.get_start_address();
+      cout << dec << cached.get_byte_count()
+           << " bytes loaded, start address = " << setw(16) << setfill('0')
+           << hex << start_address << endl;
+      if (is_verbose) {
+        cout << "Mapped " << dec << mapped_pages
+             << " pages from the image cache" << endl;
+      }
+      return true;
+    }
+    built.reset(new image_cache());
+  }
+  uint64_t byte_count = 0;
+  unsigned int threads = 1;
+  if (load_threads > 1 && input.size() >= parallel_load_size &&
+      load_hex_parallel(input.data(), input.size(), built, start_address,
+                        byte_count)) {
+    threads = load_threads;
+  } else if (!load_hex(input.data(), input.size(), built, start_address,
+                       byte_count)) {
+    return false;
+  }
+  if (built) {
+    built->save(image_cache::sidecar_name(file_name), key, start_address,
+                byte_count);  // no cache if it cannot be written
+  }
+  cout << dec << byte_count << " bytes loaded, start address = " << setw(16)
+       << setfill('0') << hex << start_address << endl;
+  if (is_verbose) {
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout << "Loaded " << dec << input.size() << " bytes of hex at " << fixed
+         << setprecision(1) << input.size() / 1e6 / elapsed.count()
+         << " MB/s with " << threads << " threads" << endl;
+  }
+  return true;
+}
+
+// Note a data record in the image cache being built, unless it was written
+// to a device: loading it again must write to the device again
+void memory::cache_record(unique_ptr<image_cache>& built, uint64_t address,
+                          const uint8_t* bytes, uint64_t length) {
+  if (!built || length == 0) {
+    return;
+  }
+  if (store.find(address)->io != nullptr ||
+      store.find(address + length - 1)->io != nullptr) {
+    built.reset();
+  } else {
+    built->add(address, bytes, length);
+  }
+}
+
+bool memory::load_hex(const char* text, uint64_t size,
+                      unique_ptr<image_cache>& built, uint64_t& start_address,
+                      uint64_t& byte_count) {
+  const char* end = text + size;
   unsigned int line_count = 0;
-  unsigned int byte_count = 0;
-  char record_start;
-  char byte_string[3];
-  char halfword_string[5];
-  unsigned int record_length;
-  unsigned int record_address;
-  unsigned int record_type;
-  unsigned int record_data;
-  unsigned int record_checksum;
-  bool end_of_file_record = false;
-  uint64_t load_address;
-  uint64_t load_data;
-  uint64_t load_mask;
+  uint8_t record[260];  // length, address (2), type, data (255), checksum
   uint64_t load_base_address = 0x0000000000000000ULL;
   start_address = 0x0000000000000000ULL;
-  if (input_file.is_open()) {
-    while (true) {
-      line_count++;
-      input_file >> record_start;
-      if (record_start != ':') {
-        cout << "Input line " << dec << line_count
-             << " does not start with colon character" << endl;
-        return false;
-      }
-      input_file.get(byte_string, 3);
-      sscanf(byte_string, "%x", &record_length);
-      input_file.get(halfword_string, 5);
-      sscanf(halfword_string, "%x", &record_address);
-      input_file.get(byte_string, 3);
-      sscanf(byte_string, "%x", &record_type);
-      switch (record_type) {
-        case 0x00:  // Data record
-          for (unsigned int i = 0; i < record_length; i++) {
-            input_file.get(byte_string, 3);
-            sscanf(byte_string, "%x", &record_data);
-            load_address = (load_base_address | (uint64_t)(record_address)) + i;
-            load_data = (uint64_t)(record_data) << ((load_address % 8) * 8);
-            load_mask = 0x00000000000000ffULL << ((load_address % 8) * 8);
-            write_doubleword(load_address & 0xfffffffffffffff8ULL, load_data,
-                             load_mask);
-            byte_count++;
-          }
-          break;
-        case 0x01:  // End of file
-          end_of_file_record = true;
-          break;
-        case 0x02:  // Extended segment address (set bits 19:4 of load base
-                    // address)
-          load_base_address = 0x0000000000000000ULL;
-          for (unsigned int i = 0; i < record_length; i++) {
-            input_file.get(byte_string, 3);
-            sscanf(byte_string, "%x", &record_data);
-            load_base_address = (load_base_address << 8) | (record_data << 4);
-          }
-          break;
-        case 0x03:  // Start segment address (ignored)
-          for (unsigned int i = 0; i < record_length; i++) {
-            input_file.get(byte_string, 3);
-            sscanf(byte_string, "%x", &record_data);
-          }
-          break;
-        case 0x04:  // Extended linear address (set upper halfword of load base
-                    // address)
-          load_base_address = 0x0000000000000000ULL;
-          for (unsigned int i = 0; i < record_length; i++) {
-            input_file.get(byte_string, 3);
-            sscanf(byte_string, "%x", &record_data);
-            load_base_address = (load_base_address << 8) | (record_data << 16);
-          }
-          break;
-        case 0x05:  // Start linear address (set execution start address)
-          start_address = 0x0000000000000000ULL;
-          for (unsigned int i = 0; i < record_length; i++) {
-            input_file.get(byte_string, 3);
-            sscanf(byte_string, "%x", &record_data);
-            start_address = (start_address << 8) | record_data;
+  byte_count = 0;
+  while (true) {
+    hex_record_status status = read_hex_record(text, end, record);
+    if (status == RECORD_NONE) {
+      break;  // no end of file record
+    }
+    line_count++;
+    if (status == RECORD_NO_COLON) {
+      cout << "Input line " << dec << line_count
+           << " does not start with colon character" << endl;
+      return false;
+    } else if (status == RECORD_INVALID) {
+      cout << "Input line " << dec << line_count
+           << " is not a valid record" << endl;
+      return false;
+    } else if (status == RECORD_BAD_CHECKSUM) {
+      cout << "Input line " << dec << line_count << " has a bad checksum"
+           << endl;
+      return false;
+    }
+    unsigned int record_length = record[0];
+    unsigned int record_address = record[1] << 8 | record[2];
+    const uint8_t* record_bytes = record + 4;
+    bool end_of_file_record = false;
+    switch (record[3]) {
+      case 0x00:  // Data record
+        write_block(load_base_address | (uint64_t)(record_address),
+                    record_bytes, record_length);
+        byte_count += record_length;
+        cache_record(built, load_base_address | (uint64_t)(record_address),
+                     record_bytes, record_length);
+        break;
+      case 0x01:  // End of file
+        end_of_file_record = true;
+        break;
+      case 0x02:  // Extended segment address (set bits 19:4 of load base
+                  // address)
+        load_base_address = 0x0000000000000000ULL;
+        for (unsigned int i = 0; i < record_length; i++) {
+          load_base_address =
+              (load_base_address << 8) | ((uint64_t)record_bytes[i] << 4);
+        }
+        break;
+      case 0x03:  // Start segment address (ignored)
+        break;
+      case 0x04:  // Extended linear address (set upper halfword of load base
+                  // address)
+        load_base_address = 0x0000000000000000ULL;
+        for (unsigned int i = 0; i < record_length; i++) {
+          load_base_address =
+              (load_base_address << 8) | ((uint64_t)record_bytes[i] << 16);
+        }
+        break;
+      case 0x05:  // Start linear address (set execution start address)
+        start_address = 0x0000000000000000ULL;
+        for (unsigned int i = 0; i < record_length; i++) {
+          start_address = (start_address << 8) | record_bytes[i];
+        }
+        break;
+    }
+    if (end_of_file_record) break;
+  }
+  return true;
+}
+
+// The file is split after newlines into chunks, several per thread, which
+// are decoded in parallel into their own buffers. A prefix pass over the
+// chunks then gives each the extended address it starts with, and the
+// records are found the pages they write. A page written by one chunk only
+// is copied into by that chunk's worker, with no locking, as no other
+// thread touches it. Pages written by several chunks, device pages and
+// watched pages are written here afterwards, in file order, so the result
+// is that of the sequential loader. If any record before the end of file
+// is bad, nothing has been written, and false is returned so that the
+// sequential loader can report it.
+bool memory::load_hex_parallel(const char* text, uint64_t size,
+                               unique_ptr<image_cache>& built,
+                               uint64_t& start_address, uint64_t& byte_count) {
+  const char* end = text + size;
+  unsigned int chunk_count = 4 * load_threads;
+  vector<hex_chunk> chunks;
+  const char* chunk_begin = text;
+  for (unsigned int c = 1; c <= chunk_count && chunk_begin < end; c++) {
+    const char* chunk_end = max(chunk_begin, text + size / chunk_count * c);
+    chunk_end = (const char*)memchr(chunk_end, '\n', end - chunk_end);
+    chunk_end = (chunk_end == nullptr || c == chunk_count) ? end : chunk_end + 1;
+    chunks.push_back(hex_chunk(chunk_begin, chunk_end));
+    chunk_begin = chunk_end;
+  }
+  parallel_for(chunks.size(), load_threads,
+               [&](unsigned int c) { chunks[c].decode(); });
+
+  // Prefix pass, up to the chunk with the end of file record
+  unsigned int used = 0;
+  vector<uint64_t> start_base;
+  uint64_t base = 0;
+  start_address = 0;
+  byte_count = 0;
+  for (hex_chunk& chunk : chunks) {
+    if (chunk.error) {
+      return false;
+    }
+    start_base.push_back(base);
+    if (chunk.base_set) {
+      base = chunk.base;
+    }
+    if (chunk.start_set) {
+      start_address = chunk.start_address;
+    }
+    used++;
+    if (chunk.end_of_file) {
+      break;
+    }
+  }
+  auto record_address = [&](unsigned int c, const hex_data_record& r) {
+    return (r.base_known ? r.base : start_base[c]) | (uint64_t)r.address;
+  };
+
+  // The pages written, and by which chunks
+  unordered_map<uint64_t, load_page> pages;
+  for (unsigned int c = 0; c < used; c++) {
+    uint64_t last = 1;  // never a page address
+    for (const hex_data_record& r : chunks[c].records) {
+      byte_count += r.length;
+      for_each_page(record_address(c, r), r.length,
+                    [&](uint64_t page_address, uint64_t, uint64_t, uint64_t) {
+        if (page_address != last) {
+          last = page_address;
+          auto entry = pages.insert(make_pair(page_address,
+                                              load_page{nullptr, (int)c, false}));
+          if (entry.first->second.owner != (int)c) {
+            entry.first->second.owner = -1;
           }
-          break;
-      }
-      input_file.get(byte_string, 3);
-      sscanf(byte_string, "%x", &record_checksum);
-      input_file.ignore();
-      if (end_of_file_record) break;
-    }
-    input_file.close();
-    cout << dec << byte_count << " bytes loaded, start address = " << setw(16)
-         << setfill('0') << hex << start_address << endl;
+        }
+      });
+    }
+  }
+  vector<uint64_t> addresses;
+  for (auto& p : pages) {
+    addresses.push_back(p.first);
+  }
+  sort(addresses.begin(), addresses.end());
+  uint64_t indirect_pages = 0;
+  for (uint64_t address : addresses) {
+    load_page& l = pages[address];
+    l.p = writable(address);
+    l.p->generation++;
+    l.direct = l.owner >= 0 && l.p->io == nullptr && l.p->watches == 0 &&
+               !journaling;
+    indirect_pages += !l.direct;
+    if (l.p->io != nullptr) {
+      built.reset();  // see cache_record
+    }
+  }
+
+  // Workers copy into the pages only their chunk writes
+  parallel_for(used, load_threads, [&](unsigned int c) {
+    const hex_chunk& chunk = chunks[c];
+    uint64_t last = 1;
+    const load_page* l = nullptr;
+    for (const hex_data_record& r : chunk.records) {
+      for_each_page(record_address(c, r), r.length,
+                    [&](uint64_t page_address, uint64_t offset,
+                        uint64_t done, uint64_t length) {
+        if (page_address != last) {
+          last = page_address;
+          l = &pages.find(page_address)->second;
+        }
+        if (l->direct) {
+          memcpy((uint8_t*)l->p->data + offset,
+                 &chunk.data[r.offset + done], length);
+        }
+      });
+    }
+  });
+
+  // The other pages, and the image cache, in file order
+  if (indirect_pages == 0 && !built) {
     return true;
+  }
+  for (unsigned int c = 0; c < used; c++) {
+    const hex_chunk& chunk = chunks[c];
+    uint64_t last = 1;
+    const load_page* l = nullptr;
+    for (const hex_data_record& r : chunk.records) {
+      uint64_t address = record_address(c, r);
+      for_each_page(address, r.length,
+                    [&](uint64_t page_address, uint64_t offset,
+                        uint64_t done, uint64_t length) {
+        if (page_address != last) {
+          last = page_address;
+          l = &pages.find(page_address)->second;
+        }
+        if (!l->direct) {
+          write_block(page_address + offset, &chunk.data[r.offset + done],
+                      length);
+        }
+      });
+      if (built) {
+        built->add(address, &chunk.data[r.offset], r.length);
+      }
+    }
+  }
+  return true;
+}
+
+// The load message is the one for a hex file, counting the bytes from the
+// file. The bss of each segment is only cleared where store already has
+// pages; anywhere else it reads as zeros until written.
+bool memory::load_elf(string file_name, const char* data, uint64_t size,
+                      uint64_t& start_address) {
+  elf_file image;
+  if (!image.parse(data, size)) {
+    cout << "Not a RISC-V ELF64 file" << endl;
+    return false;
+  }
+  int fd = open(file_name.c_str(), O_RDONLY);
+  uint64_t byte_count = 0;
+  uint64_t mapped_pages = 0;
+  for (const elf_segment& s : image.get_segments()) {
+    mapped_pages += map_segment(fd, s, data);
+    byte_count += s.file_size;
+    uint64_t address = s.address + s.file_size;
+    uint64_t end = s.address + s.memory_size;
+    while (address < end) {
+      uint64_t chunk = min(end - address, 4096 - address % 4096);
+      if (store.find(address) != nullptr) {
+        write_block(address, (const uint8_t*)zeros, chunk);
+      }
+      address += chunk;
+    }
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  symbols.swap(image.get_symbols());
+  start_address = image.get_entry();
+  cout << dec << byte_count << " bytes loaded, start address = " << setw(16)
+       << setfill('0') << hex << start_address << endl;
+  if (is_verbose) {
+    cout << "Mapped " << dec << mapped_pages << " pages from the file, "
+         << symbols.size() << " symbols" << endl;
+  }
+  return true;
+}
+
+// Enter a page whose data is mapped from a file, unless store already has
+// the page or it is in a RAM region. Returns false if it is not entered.
+bool memory::install_page(uint64_t address, uint64_t* data) {
+  if (store.find(address) != nullptr || region_data(address) != nullptr) {
+    return false;
+  }
+  page* p = store.allocate(address, data);
+  touch(p, address);
+  return true;
+}
+
+// Pages wholly inside the file part of the segment, at the same offset in
+// the file as in a guest page, and not yet in store (or a RAM region or
+// device), are mapped from the file. The rest is copied. Returns the number
+// of pages mapped.
+uint64_t memory::map_segment(int fd, const elf_segment& segment,
+                             const char* data) {
+  uint64_t first = segment.address + (4096 - segment.address % 4096) % 4096;
+  uint64_t last = segment.address + segment.file_size;
+  last -= last % 4096;
+  uint8_t* host = nullptr;
+  if (fd >= 0 && segment.offset % 4096 == segment.address % 4096 &&
+      first < last) {
+    void* mapped = mmap(nullptr, last - first, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE, fd,
+                        segment.offset + (first - segment.address));
+    if (mapped != MAP_FAILED) {
+      host = (uint8_t*)mapped;
+      file_mappings.push_back(make_pair(mapped, last - first));
+    }
+  }
+  uint64_t mapped_pages = 0;
+  uint64_t address = segment.address;
+  uint64_t end = segment.address + segment.file_size;
+  while (address < end) {
+    uint64_t chunk = min(end - address, 4096 - address % 4096);
+    if (host != nullptr && address >= first && address < last &&
+        install_page(address, (uint64_t*)(host + (address - first)))) {
+      mapped_pages++;
+    } else {
+      write_block(address, (const uint8_t*)data + segment.offset +
+                               (address - segment.address), chunk);
+    }
+    address += chunk;
+  }
+  if (host != nullptr && mapped_pages == 0) {
+    munmap(host, last - first);  // every page was already in store
+    file_mappings.pop_back();
+  }
+  return mapped_pages;
+}
+
+// Pages of the image are mapped where store has none. Elsewhere only the
+// bytes the hex file wrote (the runs) are copied, as loading it would.
+// Returns the number of pages mapped.
+uint64_t memory::load_image(image_cache& image) {
+  uint64_t count = image.get_page_count();
+  vector<bool> installed(count);
+  uint64_t mapped_pages = 0;
+  for (uint64_t p = 0; p < count; p++) {
+    installed[p] = install_page(image.page_address(p), image.page_data(p));
+    mapped_pages += installed[p];
+  }
+  uint64_t p = 0;  // runs and pages are both in address order
+  for (uint64_t r = 0; r < image.get_run_count(); r++) {
+    uint64_t address = image.run_address(r);
+    uint64_t end = address + image.run_length(r);
+    while (address < end) {
+      uint64_t offset = address % 4096;
+      uint64_t chunk = min(end - address, 4096 - offset);
+      while (image.page_address(p) != address - offset) {
+        p++;
+      }
+      if (!installed[p]) {
+        write_block(address, (const uint8_t*)image.page_data(p) + offset,
+                    chunk);
+      }
+      address += chunk;
+    }
+  }
+  if (mapped_pages > 0) {
+    file_mappings.push_back(image.release());
+  }
+  return mapped_pages;
+}
+
+// Raw files are moved a buffer at a time when they cannot be mapped
+static const uint64_t stream_buffer_size = 1 << 20;
+
+// A regular file is loaded as a segment of an ELF file would be: pages
+// not yet in store are mapped from the file if the address is page
+// aligned, and the rest is copied from a mapping of the whole file. Any
+// other file (a pipe) is read a buffer at a time.
+bool memory::load_binary(string file_name, uint64_t address,
+                         uint64_t& length) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  struct stat status;
+  if (fd < 0 || fstat(fd, &status) != 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    cout << "Failed to open file" << endl;
+    return false;
+  }
+  uint64_t mapped_pages = 0;
+  length = 0;
+  if (S_ISREG(status.st_mode)) {
+    mapped_file input;
+    if (!input.open(file_name)) {
+      close(fd);
+      cout << "Failed to open file" << endl;
+      return false;
+    }
+    elf_segment segment = {address, 0, input.size(), input.size()};
+    mapped_pages = map_segment(fd, segment, input.data());
+    length = input.size();
   } else {
+    vector<uint8_t> buffer(stream_buffer_size);
+    ssize_t got;
+    while ((got = ::read(fd, buffer.data(), buffer.size())) > 0) {
+      write_block(address + length, buffer.data(), got);
+      length += got;
+    }
+    if (got < 0) {
+      close(fd);
+      cout << "Failed to read file" << endl;
+      return false;
+    }
+  }
+  close(fd);
+  if (is_verbose) {
+    cout << "Mapped " << dec << mapped_pages << " pages from the file"
+         << endl;
+  }
+  return true;
+}
+
+static bool write_all(int fd, const uint8_t* data, uint64_t length) {
+  while (length > 0) {
+    ssize_t put = ::write(fd, data, length);
+    if (put <= 0) {
+      return false;
+    }
+    data += put;
+    length -= put;
+  }
+  return true;
+}
+
+// Copied out a buffer at a time. Pages never written (outside RAM
+// regions) are zeros without being looked at; in a regular file they are
+// left as holes, so a sparse range makes a sparse file. A regular file is
+// written to a temporary name and renamed over the target, as
+// image_cache::save does: the target may be mapped into store by lb or an
+// ELF load, and truncating it in place would fault those pages.
+bool memory::save_binary(string file_name, uint64_t address,
+                         uint64_t length) {
+  struct stat status;
+  bool exists = stat(file_name.c_str(), &status) == 0;
+  bool replace = !exists || S_ISREG(status.st_mode);
+  mode_t mode = exists ? status.st_mode & 07777 : 0666;
+  string temporary = file_name + ".tmp" + to_string(getpid());
+  int fd = replace ? open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL, mode)
+                   : open(file_name.c_str(), O_WRONLY);
+  if (fd < 0 || fstat(fd, &status) != 0) {
+    if (fd >= 0) {
+      close(fd);
+      remove(temporary.c_str());
+    }
     cout << "Failed to open file" << endl;
     return false;
   }
+  bool sparse = S_ISREG(status.st_mode);
+  vector<uint8_t> buffer(stream_buffer_size);
+  uint64_t buffered = 0;
+  uint64_t done = 0;
+  bool ok = true;
+  while (ok && done < length) {
+    uint64_t at = address + done;
+    uint64_t chunk = min(length - done, 4096 - at % 4096);
+    bool absent = store.find(at) == nullptr && region_data(at) == nullptr;
+    if (absent && sparse && chunk == 4096) {
+      ok = write_all(fd, buffer.data(), buffered) &&
+           lseek(fd, chunk, SEEK_CUR) >= 0;
+      buffered = 0;
+    } else {
+      if (absent) {
+        memset(buffer.data() + buffered, 0, chunk);
+      } else {
+        read_block(at, buffer.data() + buffered, chunk);
+      }
+      buffered += chunk;
+      if (buffered + 4096 > buffer.size()) {
+        ok = write_all(fd, buffer.data(), buffered);
+        buffered = 0;
+      }
+    }
+    done += chunk;
+  }
+  ok = ok && write_all(fd, buffer.data(), buffered);
+  if (ok && sparse) {
+    ok = ftruncate(fd, length) == 0;  // for a hole at the end
+  }
+  ok = close(fd) == 0 && ok;
+  if (replace) {
+    ok = ok && rename(temporary.c_str(), file_name.c_str()) == 0;
+    if (!ok) {
+      remove(temporary.c_str());
+    }
+  }
+  if (!ok) {
+    cout << "Failed to write file" << endl;
+    return false;
+  }
+  return true;
+}
+
+void memory::set_load_threads(unsigned int threads) {
+  load_threads = max(1u, threads);
+}
+
+void memory::set_image_cache(bool enabled) { use_image_cache = enabled; }
+
+const vector<elf_symbol>& memory::get_symbols() { return symbols; }
+
+bool memory::find_symbol(string name, uint64_t& address) {
+  for (auto& s : symbols) {
+    if (s.name == name) {
+      address = s.address;
+      return true;
+    }
+  }
+  return false;
 }
@@ -9,16 +9,114 @@
 
 **************************************************************** */
 
+#include <cstdint>
+#include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <utility>
+
+#include "decoder.h"
+#include "device.h"
+#include "elf_file.h"
+#include "image_cache.h"
+#include "page_table.h"
 
 using namespace std;
 
+// A contiguous region of guest RAM backed by one host mapping
+struct ram_region {
+  uint64_t base;
+  uint64_t size;
+  uint64_t* host;
+};
+
+// A page of a snapshot: its contents when the snapshot was taken. These
+// are shared with the live page until that is next written.
+struct snapshot_page {
+  uint64_t* data;
+  unique_ptr<uint64_t[]> copy;  // data, once no longer shared
+};
+
+// A snapshot of store, as the pages that may differ from its parent (or,
+// for the first, from empty store)
+struct memory_snapshot {
+  int parent;  // -1 for none
+  unordered_map<uint64_t, snapshot_page> pages;
+};
+
 class memory {
 
  private:
- unordered_map<uint64_t, vector<uint64_t>> store;
+ page_table store;
  bool is_verbose;
+
+ // Never-written pages are read as zero_page. Those that have been read
+ // are marked in store, for statistics.
+ uint64_t zeros[512];
+ page zero_page;
+ const page* readable(uint64_t address);
+
+ // Snapshots, by id. Once one is taken, pages accessed since the snapshot
+ // taken or restored last (base_snapshot) are listed in dirty_pages.
+ vector<unique_ptr<memory_snapshot>> snapshots;
+ int base_snapshot;
+ vector<uint64_t> dirty_pages;
+ uint64_t restored_pages;
+ void track(page* p, uint64_t address);
+ page* writable(uint64_t address);
+ const uint64_t* snapshot_data(int id, uint64_t address);
+
+ // Declared RAM regions. Their pages take their data from the region.
+ vector<ram_region> regions;
+ uint64_t* region_data(uint64_t address);
+
+ // Images loaded from ELF files, raw files and image caches. Whole pages
+ // are mapped privately from the file, so they are only copied if written;
+ // the mappings (host address and length) last as long as store. A mapped
+ // file must not be truncated in place while loaded, or reading its pages
+ // faults: save_binary replaces files by renaming for this reason.
+ vector<pair<void*, uint64_t>> file_mappings;
+ vector<elf_symbol> symbols;
+ bool install_page(uint64_t address, uint64_t* data);
+
+ // Hex files of parallel_load_size bytes or more are decoded by
+ // load_threads threads
+ static const uint64_t parallel_load_size = 1 << 22;
+ unsigned int load_threads;
+ bool use_image_cache;
+ bool load_hex(const char* text, uint64_t size, unique_ptr<image_cache>& built,
+               uint64_t& start_address, uint64_t& byte_count);
+ bool load_hex_parallel(const char* text, uint64_t size,
+                        unique_ptr<image_cache>& built,
+                        uint64_t& start_address, uint64_t& byte_count);
+ void cache_record(unique_ptr<image_cache>& built, uint64_t address,
+                   const uint8_t* bytes, uint64_t length);
+ bool load_elf(string file_name, const char* data, uint64_t size,
+               uint64_t& start_address);
+ uint64_t map_segment(int fd, const elf_segment& segment, const char* data);
+ uint64_t load_image(image_cache& image);
+
+ // Device regions. Their pages are entered when the device is attached,
+ // so RAM accesses never look at the devices, and a device access is found
+ // by the same page lookup.
+ vector<unique_ptr<mmio_region>> devices;
+ uint64_t device_pages;
+ void device_write(const page* p, uint64_t address, uint64_t data,
+                   uint64_t mask);
+
+ // Old values of doublewords written while journaling (JIT self-check)
+ bool journaling;
+ vector<pair<uint64_t, uint64_t>> journal;
+
+ // Watched doublewords and the accesses they are watched for. Only pages
+ // with a watch pay for the lookup.
+ unordered_map<uint64_t, unsigned int> watchpoints;
+ bool watch_hit;
+ uint64_t watch_hit_address;
+ unsigned int watch_hit_kind;
+ void check_watch(uint64_t address, unsigned int kind);
   // TODO: Add private members here
 
   // hints:
@@ -30,12 +128,40 @@ class memory {
 
  public:
 
+  static const unsigned int WATCH_WRITE = 1;
+  static const unsigned int WATCH_READ = 2;
 
   // Constructor
   memory(bool verbose);
+  ~memory();
+
+  // Back size bytes of guest RAM from base with a single host mapping,
+  // which the kernel fills with zeros as it is touched, optionally asking
+  // for huge pages. Must be done before any memory in the range is used.
+  // Returns false, leaving the range to the sparse store, if the mapping
+  // fails or the range is not page aligned or overlaps another region.
+  bool add_region(uint64_t base, uint64_t size, bool huge_pages);
+
+  // Give the pages from base to base + size to a device. Must be done
+  // before any memory in the range is used. Returns false if the range is
+  // not page aligned or overlaps a RAM region or another device.
+  bool attach_device(uint64_t base, uint64_t size, device* handler);
 
-   //validate whether block is allocated
-   void validate (uint64_t address);
+  // Push out the devices' buffered output
+  void flush_devices();
+
+   //validate whether block is allocated, and return the page holding address.
+   //Only writes should allocate; reads go through the shared zero page.
+   page* validate (uint64_t address);
+
+  // Return the page holding address, or nullptr if it is not allocated
+  page* find_page (uint64_t address);
+
+  // Hash of the addresses and contents of all allocated pages
+  uint64_t content_hash ();
+
+  // Return the page holding address with its predecode side table allocated.
+  page* code_page (uint64_t address);
   	 
   // Read a doubleword of data from a doubleword-aligned address.
   // If the address is not a multiple of 8, it is rounded down to a multiple of 8.
@@ -46,10 +172,85 @@ class memory {
   // The mask contains 1s for bytes to be updated and 0s for bytes that are to be unchanged.
   void write_doubleword (uint64_t address, uint64_t data, uint64_t mask);
 
+  // Typed accesses, made directly on the page in host byte order (which is
+  // little-endian, like the guest, on the hosts this runs on). The address
+  // must be a multiple of the size.
+  template <typename T> T read(uint64_t address);
+  template <typename T> void write(uint64_t address, T data);
+  uint8_t read_u8(uint64_t address) { return read<uint8_t>(address); }
+  uint16_t read_u16(uint64_t address) { return read<uint16_t>(address); }
+  uint32_t read_u32(uint64_t address) { return read<uint32_t>(address); }
+  uint64_t read_u64(uint64_t address) { return read<uint64_t>(address); }
+  void write_u8(uint64_t address, uint8_t data) { write(address, data); }
+  void write_u16(uint64_t address, uint16_t data) { write(address, data); }
+  void write_u32(uint64_t address, uint32_t data) { write(address, data); }
+  void write_u64(uint64_t address, uint64_t data) { write(address, data); }
+
+  // Copy length bytes from store at address to data, or from data to store
+  // at address. Both may cross pages.
+  void read_block(uint64_t address, uint8_t* data, uint64_t length);
+  void write_block(uint64_t address, const uint8_t* data, uint64_t length);
+
+  // Take a snapshot of store, returning its id. Costs O(pages accessed
+  // since the last snapshot or restore): no data is copied until written.
+  unsigned int snapshot();
+
+  // Return store to a snapshot, returning false if there is no such id.
+  // Costs O(pages that may differ between the live state and the snapshot).
+  bool restore(unsigned int id);
+
+  // Pages copied back by restores
+  uint64_t get_restored_pages();
+
+  // Must be called before writing a page's data other than through memory
+  // (as the data TLB does)
+  void touch(page* p, uint64_t address) {
+    if (base_snapshot >= 0 && !p->dirty) {
+      track(p, address);
+    }
+  }
+
+  // Record the old value of every doubleword written until end_journal,
+  // which hands back (address, old value) pairs in write order.
+  void begin_journal();
+  void end_journal(vector<pair<uint64_t, uint64_t>>& writes);
+
+  // Pages allocated (written), and pages read but never written
+  uint64_t get_allocated_pages();
+  uint64_t get_read_only_pages();
+
+  // Watch the doubleword holding address for the given kinds of access
+  void add_watchpoint(uint64_t address, unsigned int kinds);
+  bool remove_watchpoint(uint64_t address);
+  void clear_watchpoints();
+  bool watching();
+
+  // Take the first watched access made since the last call, if any
+  bool take_watch_hit(uint64_t& address, unsigned int& kind);
+
   // Load a hex image file and provide the start address for execution from the file in start_address.
   // Return true if the file was read without error, or false otherwise.
+  // An ELF file (found by its magic number) is loaded by its PT_LOAD
+  // segments, starting at its entry point. A hex file is loaded from its
+  // image cache if that is up to date, and the cache is written otherwise.
   bool load_file(string file_name, uint64_t &start_address);
 
+  // Load a raw binary file at address, setting length to its size, or
+  // save length bytes from address to a file. Return false (with a
+  // message) if the file cannot be opened, read or written.
+  bool load_binary(string file_name, uint64_t address, uint64_t& length);
+  bool save_binary(string file_name, uint64_t address, uint64_t length);
+
+  // Threads decoding large hex files (1 for none), and whether hex files
+  // are loaded from and saved to image caches
+  void set_load_threads(unsigned int threads);
+  void set_image_cache(bool enabled);
+
+  // Symbols of the last ELF file loaded, by address. find_symbol returns
+  // false if there is no symbol called name.
+  const vector<elf_symbol>& get_symbols();
+  bool find_symbol(string name, uint64_t& address);
+
 };
 
 #endif
@@ -0,0 +1,104 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Class members for page_table
+
+**************************************************************** */
+
+#include "page_table.h"
+
+using namespace std;
+
+predecoded_page::predecoded_page() {
+  for (int i = 0; i < 1024; i++) {
+    stamp[i] = ~0ULL;  // never matches a page generation
+  }
+}
+
+// Constructor
+page_table::page_table() {
+  pages_used = frames_per_chunk;
+  frames_used = frames_per_chunk;
+  allocated = 0;
+  marked = 0;
+  root = new_node();
+}
+
+page_table::node* page_table::new_node() {
+  nodes.push_back(unique_ptr<node>(new node()));
+  return nodes.back().get();
+}
+
+// The leaf slot for address, making the nodes above it if needed
+void*& page_table::leaf(uint64_t address) {
+  uint64_t number = address >> 12;
+  node* n = root;
+  for (unsigned int level = levels - 1; level > 0; level--) {
+    void*& child = n->child[(number >> (level * index_bits)) & index_mask];
+    if (child == nullptr) {
+      child = new_node();
+    }
+    n = (node*)child;
+  }
+  return n->child[number & index_mask];
+}
+
+void page_table::mark_read(uint64_t address) {
+  void*& slot = leaf(address);
+  if (slot == nullptr) {
+    slot = (void*)read_mark;
+    marked++;
+  }
+}
+
+page* page_table::allocate(uint64_t address, uint64_t* data) {
+  void*& leaf = this->leaf(address);
+  if ((uintptr_t)leaf == read_mark) {
+    leaf = nullptr;
+    marked--;
+  }
+  if (leaf == nullptr) {
+    if (pages_used == frames_per_chunk) {
+      pages_pool.push_back(unique_ptr<page[]>(new page[frames_per_chunk]()));
+      pages_used = 0;
+    }
+    page* allocated_page = &pages_pool.back()[pages_used++];
+    if (data == nullptr) {
+      if (frames_used == frames_per_chunk) {
+        frames_pool.push_back(
+            unique_ptr<uint64_t[]>(new uint64_t[512 * frames_per_chunk]()));
+        frames_used = 0;
+      }
+      data = &frames_pool.back()[512 * frames_used++];
+    }
+    allocated_page->data = data;
+    leaf = allocated_page;
+    allocated++;
+  }
+  return (page*)leaf;
+}
+
+void page_table::collect(node* n, unsigned int level, uint64_t number,
+                         vector<pair<uint64_t, page*>>& found) {
+  for (uint64_t i = 0; i <= index_mask; i++) {
+    if (n->child[i] == nullptr || (uintptr_t)n->child[i] == read_mark) {
+      continue;
+    }
+    uint64_t child_number = (number << index_bits) | i;
+    if (level == 0) {
+      found.push_back(make_pair(child_number << 12, (page*)n->child[i]));
+    } else {
+      collect((node*)n->child[i], level - 1, child_number, found);
+    }
+  }
+}
+
+void page_table::pages(vector<pair<uint64_t, page*>>& found) {
+  found.clear();
+  collect(root, levels - 1, 0, found);
+}
+
+uint64_t page_table::size() { return allocated; }
+
+uint64_t page_table::read_size() { return marked; }
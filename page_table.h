@@ -0,0 +1,126 @@
+#ifndef PAGE_TABLE_H
+#define PAGE_TABLE_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Radix tree of the allocated pages of store
+
+**************************************************************** */
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "decoder.h"
+
+using namespace std;
+
+// Instructions predecoded from one page of store, two per doubleword.
+// An entry is valid while its stamp equals the generation of the page.
+struct predecoded_page {
+  decoded_instruction inst[1024];
+  uint64_t stamp[1024];
+  predecoded_page();
+};
+
+struct snapshot_page;
+struct mmio_region;
+
+// A page of store: 4Kbytes (512 doublewords) of data, a count of the writes
+// made to it, and the predecode side table if the page has been executed.
+// The data is a frame from the pool, or part of a RAM region. Pages are
+// never moved or freed, so pointers to them and their data stay valid.
+// A page claimed by a device has io set; its accesses go to the device and
+// its data is the zero page's, never written.
+struct page {
+  uint64_t* data;
+  uint64_t generation;
+  unique_ptr<predecoded_page> code;
+  unsigned int watches;  // watchpoints in this page
+  snapshot_page* shared;  // snapshot sharing data, copied out before a write
+  bool dirty;             // accessed since the last snapshot or restore
+  mmio_region* io;        // device claiming the page, or null for RAM
+};
+
+// The 52-bit page number is split into four 13-bit indexes, one per level.
+// Finding a page is four dependent loads with no hashing; page frames come
+// from a pool allocated a chunk at a time. A leaf with read_mark set holds
+// no page: it records that the page has been read while unallocated.
+class page_table {
+
+ private:
+  static const unsigned int index_bits = 13;
+  static const unsigned int levels = 4;
+  static const uint64_t index_mask = (1ULL << index_bits) - 1;
+  static const unsigned int frames_per_chunk = 64;
+  static const uintptr_t read_mark = 1;
+
+  struct node {
+    void* child[1ULL << index_bits];  // nodes of the next level, or pages
+  };
+
+  node* root;
+  vector<unique_ptr<node>> nodes;
+  vector<unique_ptr<page[]>> pages_pool;       // page descriptors
+  vector<unique_ptr<uint64_t[]>> frames_pool;  // page frames
+  unsigned int pages_used;   // in the last chunk of pages_pool
+  unsigned int frames_used;  // in the last chunk of frames_pool
+  uint64_t allocated;
+  uint64_t marked;  // leaves holding read_mark
+
+  node* new_node();
+  void*& leaf(uint64_t address);
+  void collect(node* n, unsigned int level, uint64_t number,
+               vector<pair<uint64_t, page*>>& found);
+
+ public:
+
+  // Constructor
+  page_table();
+
+  // Return the page holding address, or nullptr if it is not allocated,
+  // setting read if it is not allocated but has been marked as read
+  page* find(uint64_t address, bool& read) {
+    uint64_t number = address >> 12;
+    node* n = root;
+    read = false;
+    for (unsigned int level = levels - 1; level > 0; level--) {
+      n = (node*)n->child[(number >> (level * index_bits)) & index_mask];
+      if (n == nullptr) {
+        return nullptr;
+      }
+    }
+    void* leaf = n->child[number & index_mask];
+    read = (uintptr_t)leaf == read_mark;
+    return read ? nullptr : (page*)leaf;
+  }
+
+  page* find(uint64_t address) {
+    bool read;
+    return find(address, read);
+  }
+
+  // Mark the unallocated page holding address as read, so that it is
+  // counted once however often it is read
+  void mark_read(uint64_t address);
+
+  // Return the page holding address, allocating it if needed with data
+  // (zeroed, or the page's initial contents), or a zeroed frame from the
+  // pool if data is null
+  page* allocate(uint64_t address, uint64_t* data = nullptr);
+
+  // Page addresses and pages, in address order
+  void pages(vector<pair<uint64_t, page*>>& found);
+
+  // Number of pages allocated
+  uint64_t size();
+
+  // Number of pages read but not allocated
+  uint64_t read_size();
+
+};
+
+#endif
@@ -0,0 +1,108 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Class members for plic
+
+**************************************************************** */
+
+#include "plic.h"
+
+using namespace std;
+
+// Registers, by offset, for context 0
+static const uint64_t PLIC_PRIORITY = 0x0;  // 4 bytes per source
+static const uint64_t PLIC_PENDING = 0x1000;
+static const uint64_t PLIC_ENABLE = 0x2000;
+static const uint64_t PLIC_THRESHOLD = 0x200000;
+static const uint64_t PLIC_CLAIM = 0x200004;
+
+// Constructor
+plic::plic(processor* hart) {
+  cpu = hart;
+  for (unsigned int s = 0; s < sources; s++) {
+    priority[s] = 0;
+  }
+  level = 0;
+  pending = 0;
+  enable = 0;
+  claimed = 0;
+  threshold = 0;
+}
+
+unsigned int plic::best_source() {
+  unsigned int best = 0;
+  for (unsigned int s = 1; s < sources; s++) {
+    if ((pending & enable & ~claimed) >> s & 1 &&
+        priority[s] > threshold && priority[s] > priority[best]) {
+      best = s;
+    }
+  }
+  return best;
+}
+
+void plic::update_interrupt() {
+  cpu->set_interrupt(0x800, best_source() != 0);  // mip.MEIP
+}
+
+// Registers are 32 bits; a doubleword access reaches the lower one only
+uint64_t plic::read(uint64_t offset, unsigned int size) {
+  if (offset < PLIC_PRIORITY + 4 * sources) {
+    return offset % 4 ? 0 : priority[offset / 4];
+  }
+  switch (offset) {
+    case PLIC_PENDING:
+      return pending;
+    case PLIC_ENABLE:
+      return enable;
+    case PLIC_THRESHOLD:
+      return threshold;
+    case PLIC_CLAIM: {
+      unsigned int source = best_source();
+      if (source != 0) {
+        claimed |= 1U << source;
+        pending &= ~(1U << source);
+        update_interrupt();
+      }
+      return source;
+    }
+    default:
+      return 0;
+  }
+}
+
+void plic::write(uint64_t offset, uint64_t data, unsigned int size) {
+  if (offset < PLIC_PRIORITY + 4 * sources) {
+    if (offset % 4 == 0 && offset != 0) {
+      priority[offset / 4] = data & 7;
+    }
+  } else if (offset == PLIC_ENABLE) {
+    enable = data & ~1U;  // there is no source 0
+  } else if (offset == PLIC_THRESHOLD) {
+    threshold = data & 7;
+  } else if (offset == PLIC_CLAIM) {  // completion
+    if (data < sources) {
+      claimed &= ~(1U << data);
+      pending |= level & (1U << data);  // still high: pending again
+    }
+  } else {
+    return;
+  }
+  update_interrupt();
+}
+
+void plic::set_source(unsigned int source, bool raised) {
+  if (source == 0 || source >= sources) {
+    return;
+  }
+  if (raised) {
+    level |= 1U << source;
+    if (!(claimed >> source & 1)) {
+      pending |= 1U << source;
+    }
+  } else {
+    level &= ~(1U << source);
+    pending &= ~(1U << source);
+  }
+  update_interrupt();
+}
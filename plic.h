@@ -0,0 +1,53 @@
+#ifndef PLIC_H
+#define PLIC_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Platform-level interrupt controller
+
+**************************************************************** */
+
+#include <cstdint>
+
+#include "device.h"
+#include "processor.h"
+
+using namespace std;
+
+// Sources 1 to 31, level triggered, and one context: machine mode of the
+// only hart, whose external interrupt (mip.MEIP) is raised while a source
+// is pending, enabled, and above the threshold in priority.
+class plic : public device {
+
+ private:
+  static const unsigned int sources = 32;
+
+  processor* cpu;
+  uint32_t priority[sources];
+  uint32_t level;      // sources whose line is high
+  uint32_t pending;
+  uint32_t enable;
+  uint32_t claimed;    // claimed and not yet completed
+  uint32_t threshold;
+
+  // The pending, enabled source of highest priority above the threshold,
+  // or 0 if none
+  unsigned int best_source();
+  void update_interrupt();
+
+ public:
+
+  // Constructor
+  plic(processor* hart);
+
+  uint64_t read(uint64_t offset, unsigned int size);
+  void write(uint64_t offset, uint64_t data, unsigned int size);
+
+  // Set the level of a source's interrupt line
+  void set_source(unsigned int source, bool raised);
+
+};
+
+#endif
@@ -10,27 +10,61 @@
 
 #include <stdlib.h>
 
+#include <algorithm>
+#include <chrono>
 #include <climits>
-#include <cmath>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <type_traits>
 
 #include "memory.h"
 
 using namespace std;
 
+const void* const* processor::block_handlers = nullptr;
+
 // Consructor
 processor::processor(memory* main_memory, bool verbose, bool stage2) {
   storage = main_memory;
   is_verbose = verbose;
   is_stage2 = stage2;
   priv = 3;
+  halted = false;
 
   registers = vector<uint64_t>(32);
   pc = 0;
-  breakpoint = 0xffff00ffff;
   instruction_count = 0;
+  access_offset = 0;
+  step_offset = 0;
+  breakpoint_epoch = 1;
+
+  predecode_hits = 0;
+  predecode_misses = 0;
+  fusion = true;
+  fused_pairs = 0;
+  run_block(nullptr, 0, nullptr, 0);  // set up block_handlers
+
+  jit_check = false;
+  jit_compiled = 0;
+  jit_mismatches = 0;
+  frame.registers = &registers[0];
+  frame.pc = &pc;
+  frame.cpu = this;
+  frame.block = nullptr;
+  frame.step = jit_step;
+  data_tlb_fill = true;
+  baseline = -1;
+  resets = 0;
+  reset_pages = 0;
+  reset_nanoseconds = 0;
+  fetch_tlb_hits = 0;
+  fetch_tlb_misses = 0;
+  data_tlb_hits = 0;
+  data_tlb_misses = 0;
+  mmu.reset(new sv39(storage));
+  data_tlb_satp = 0;
+  flush_tlbs();
 
   csr[0xf11] = 0;                   // mvendorid
   csr[0xf12] = 0;                   // marchid
@@ -45,916 +79,673 @@ processor::processor(memory* main_memory, bool verbose, bool stage2) {
   csr[0x342] = 0;                   // mcause
   csr[0x343] = 0;                   // mtval
   csr[0x344] = 0;                   // mip
+  csr[0x180] = 0;                   // satp
+  update_interrupt_pending();
+  update_sv39_satp();
   if (verbose) {
     cout << "Processor created" << endl;
   }
   return;
 }
 
-void processor::load_instruction(uint64_t value, uint64_t pc) {
-  curr_inst = value;
-  if (pc % 8 == 4) {
-    value = value >> 32;
-  }
-  for (int i = 31; i >= 0; i--) {  // Assuming uint64_t is 64 bits
-    current_instruction[31 - i] = ((value >> i) & 1) ? 1 : 0;
-  }  // line shifts to desired bit, uses & to isolate, 1 or 0 depending on t/f
-
-  if (is_verbose) {
-    for (int i = 0; i < 32; i++) {
-      cout << current_instruction[i];
+// decode the instruction at address in page p through its predecode side
+// table. Each instruction word is decoded once and kept until a write to
+// the page moves it to a new generation; an entry whose word that write
+// left alone is just restamped.
+const decoded_instruction& processor::predecode(page* p, uint64_t address) {
+  unsigned int index = (address % 4096) / 4;
+  predecoded_page* code = p->code.get();
+  if (code->stamp[index] == p->generation) {
+    predecode_hits++;
+  } else {
+    uint64_t fetched = p->data[index / 2];
+    uint32_t word = index % 2 ? fetched >> 32 : fetched;
+    if (code->stamp[index] != ~0ULL && code->inst[index].raw == word) {
+      predecode_hits++;
+    } else {
+      decode(word, code->inst[index]);
+      predecode_misses++;
     }
-    cout << endl;
+    code->stamp[index] = p->generation;
   }
+  return code->inst[index];
 }
 
-// find what type of instruction
-string processor::instruction_type() {
-  string opcode;
-  string funct3;
-  string funct7;
-
-  for (int i = 25; i < 32; i++) {
-    opcode.push_back(current_instruction[i] + '0');
-  }
-
-  for (int i = 17; i < 20; i++) {
-    funct3.push_back(current_instruction[i] + '0');
-  }
-
-  for (int i = 0; i < 7; i++) {
-    funct7.push_back(current_instruction[i] + '0');
-  }
-
-  if (is_verbose) {
-    cout << "opcode: " << opcode << " funct3: " << funct3;
-    cout << " funct7: " << funct7 << endl;
-  }
-
-  if (opcode == "0110111") {
-    return "LUI";
-  } else if (opcode == "0010111") {
-    return "AUIPC";
-  } else if (opcode == "1101111") {
-    return "JAL";
-  } else if (opcode == "1100111" && funct3 == "000") {
-    return "JALR";
-  } else if (opcode == "1100011" && funct3 == "000") {
-    return "BEQ";
-  } else if (opcode == "1100011" && funct3 == "001") {
-    return "BNE";
-  } else if (opcode == "1100011" && funct3 == "100") {
-    return "BLT";
-  } else if (opcode == "1100011" && funct3 == "101") {
-    return "BGE";
-  } else if (opcode == "1100011" && funct3 == "110") {
-    return "BLTU";
-  } else if (opcode == "1100011" && funct3 == "111") {
-    return "BGEU";
-  } else if (opcode == "0000011" && funct3 == "000") {
-    return "LB";
-  } else if (opcode == "0000011" && funct3 == "001") {
-    return "LH";
-  } else if (opcode == "0000011" && funct3 == "010") {
-    return "LW";
-  } else if (opcode == "0000011" && funct3 == "100") {
-    return "LBU";
-  } else if (opcode == "0000011" && funct3 == "101") {
-    return "LHU";
-  } else if (opcode == "0100011" && funct3 == "000") {
-    return "SB";
-  } else if (opcode == "0100011" && funct3 == "001") {
-    return "SH";
-  } else if (opcode == "0100011" && funct3 == "010") {
-    return "SW";
-  } else if (opcode == "0010011" && funct3 == "000") {
-    return "ADDI";
-  } else if (opcode == "0010011" && funct3 == "010") {
-    return "SLTI";
-  } else if (opcode == "0010011" && funct3 == "011") {
-    return "SLTIU";
-  } else if (opcode == "0010011" && funct3 == "100") {
-    return "XORI";
-  } else if (opcode == "0010011" && funct3 == "110") {
-    return "ORI";
-  } else if (opcode == "0010011" && funct3 == "111") {
-    return "ANDI";
-  } else if (opcode == "0010011" && funct3 == "001" && funct7 == "0000000") {
-    return "SLLI";
-  } else if (opcode == "0010011" && funct3 == "101" && funct7 == "0000000") {
-    return "SRLI";
-  } else if (opcode == "0010011" && funct3 == "101" && funct7 == "0100000") {
-    return "SRAI";
-  } else if (opcode == "0110011" && funct3 == "000" && funct7 == "0000000") {
-    return "ADD";
-  } else if (opcode == "0110011" && funct3 == "000" && funct7 == "0100000") {
-    return "SUB";
-  } else if (opcode == "0110011" && funct3 == "001" && funct7 == "0000000") {
-    return "SLL";
-  } else if (opcode == "0110011" && funct3 == "010" && funct7 == "0000000") {
-    return "SLT";
-  } else if (opcode == "0110011" && funct3 == "011" && funct7 == "0000000") {
-    return "SLTU";
-  } else if (opcode == "0110011" && funct3 == "100" && funct7 == "0000000") {
-    return "XOR";
-  } else if (opcode == "0110011" && funct3 == "101" && funct7 == "0000000") {
-    return "SRL";
-  } else if (opcode == "0110011" && funct3 == "101" && funct7 == "0100000") {
-    return "SRA";
-  } else if (opcode == "0110011" && funct3 == "110" && funct7 == "0000000") {
-    return "OR";
-  } else if (opcode == "0110011" && funct3 == "111" && funct7 == "0000000") {
-    return "AND";
-  } else if (opcode == "0001111") {
-    return "FENCE";
-  }  // 64I instructions now
-  else if (opcode == "0000011" && funct3 == "110") {
-    return "LWU";
-  } else if (opcode == "0000011" && funct3 == "011") {
-    return "LD";
-  } else if (opcode == "0100011" && funct3 == "011") {
-    return "SD";
-  } else if (opcode == "0010011" && funct3 == "001") {
-    return "SLLI";
-  } else if (opcode == "0010011" && funct3 == "101" &&
-             current_instruction[1] == 0) {
-    return "SRLI";
-  } else if (opcode == "0010011" && funct3 == "101" &&
-             current_instruction[1] == 1) {
-    return "SRAI";
-  } else if (opcode == "0011011" && funct3 == "000") {
-    return "ADDIW";
-  } else if (opcode == "0011011" && funct3 == "001" && funct7 == "0000000") {
-    return "SLLIW";
-  } else if (opcode == "0011011" && funct3 == "101" && funct7 == "0000000") {
-    return "SRLIW";
-  } else if (opcode == "0011011" && funct3 == "101" && funct7 == "0100000") {
-    return "SRAIW";
-  } else if (opcode == "0111011" && funct3 == "000" && funct7 == "0000000") {
-    return "ADDW";
-  } else if (opcode == "0111011" && funct3 == "000" && funct7 == "0100000") {
-    return "SUBW";
-  } else if (opcode == "0111011" && funct3 == "001" && funct7 == "0000000") {
-    return "SLLW";
-  } else if (opcode == "0111011" && funct3 == "101" && funct7 == "0000000") {
-    return "SRLW";
-  } else if (opcode == "0111011" && funct3 == "101" && funct7 == "0100000") {
-    return "SRAW";
-  }
-  // ZICSR extension instructions
-  string funct12;
-  for (int i = 0; i < 12; i++) {
-    funct12.push_back(current_instruction[i] + '0');
-  }
-  if (opcode == "1110011" && funct3 == "001") {
-    return "CSRRW";
-  } else if (opcode == "1110011" && funct3 == "010") {
-    return "CSRRS";
-  } else if (opcode == "1110011" && funct3 == "011") {
-    return "CSRRC";
-  } else if (opcode == "1110011" && funct3 == "101") {
-    return "CSRRWI";
-  } else if (opcode == "1110011" && funct3 == "110") {
-    return "CSRRSI";
-  } else if (opcode == "1110011" && funct3 == "111") {
-    return "CSRRCI";
-  } else if (opcode == "1110011" && funct12 == "000000000000") {
-    return "ECALL";
-  } else if (opcode == "1110011" && funct12 == "000000000001") {
-    return "EBREAK";
-  } else if (opcode == "1110011" && funct12 == "001100000010") {
-    return "MRET";
-  }
-  return "unknown command";
+// fetch the decoded instruction at a physical address through the
+// predecode cache
+const decoded_instruction& processor::fetch(uint64_t address) {
+  return predecode(code_page(address), address);
 }
 
-// return signed decimal value
-uint64_t processor::binary_return(int start, int length, bool is_signed) {
-  // bool negative = current_instruction[start];
-  uint64_t return_int = 0;
-  int power = length - 1;
-  if (is_signed == true && current_instruction[start] == 1) {
-    for (int i = start; i < start + length; i++) {
-      if (current_instruction[i] == 0) {
-        return_int = return_int + pow(2, power);
-      }
-      power--;
-    }
-    return_int = -1 * return_int - 1;
+// Return the page holding address, with its predecode table, through the
+// fetch TLB
+page* processor::code_page(uint64_t address) {
+  uint64_t page_address = address - address % 4096;
+  fetch_tlb_entry& t = fetch_tlb[(address / 4096) % fetch_tlb_size];
+  if (t.tag == page_address) {
+    fetch_tlb_hits++;
   } else {
-    for (int i = start; i < start + length; i++) {
-      if (current_instruction[i] == 1) {
-        return_int = return_int + pow(2, power);
-      }
-      power--;
-    }
+    fetch_tlb_misses++;
+    t.tag = page_address;
+    t.code = storage->code_page(address);
   }
-  return return_int;
+  return t.code;
 }
 
-// do instruction
-void processor::do_instruction(string type) {
-  if (is_verbose) {
-    cout << type << endl;
-  }
-  if(type == "unknown command"){
-    raise_exception(2);
-  }
-  if (type == "LUI") {
-    uint64_t immediate = binary_return(0, 20, 1);
-    immediate = immediate << 12;
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    set_reg(destination_reg, immediate);
-  } else if (type == "AUIPC") {
-    uint64_t immediate = binary_return(0, 20, 1);  // check if int or uint
-    immediate = immediate << 12;
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    immediate = immediate + pc;
-    set_reg(destination_reg, immediate);
-  } else if (type == "JAL") {
-    uint64_t immediate1_10 = binary_return(1, 10, 0) << 1;
-    uint64_t immediate11 = binary_return(11, 1, 0) << 11;
-    uint64_t immediate19_12 = binary_return(12, 8, 0) << 12;
-    uint64_t immediate = immediate1_10 + immediate11 + immediate19_12;
-    if (current_instruction[0] == 1) {
-      immediate = immediate + 0xfffffffffff00000;
-    }
-    // cout << dec << "immediate: " << (int)immediate << endl;
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    set_reg(destination_reg, pc + 4);
-    set_pc(pc + immediate - 4);
-  } else if (type == "JALR") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    // cout << "IMM: " << immediate << endl;
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t newpc = immediate + registers[register_1] - 4;
-    newpc = newpc - (newpc % 2);
-    set_reg(destination_reg, pc + 4);
-    // cout << hex<<"REg: " << registers[register_1] << endl;
-    set_pc(newpc);
-  } else if (type == "BEQ") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    if (registers[register_1] == registers[register_2]) {
-      uint64_t immediate11 = current_instruction[24] << 11;
-      uint64_t immediate10_5 = binary_return(1, 6, 0) << 5;
-      uint64_t immediate4_1 = binary_return(20, 4, 0) << 1;
-      uint64_t combined_immediate = immediate4_1 + immediate10_5 + immediate11;
-      if (current_instruction[0] == 1) {
-        combined_immediate = combined_immediate + 0xfffffffffffff000;
-      }
-      // cout  << dec << "immediate: " << combined_immediate << endl;
-      pc = pc + combined_immediate - 4;
-    }
-  } else if (type == "BNE") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    if (registers[register_1] != registers[register_2]) {
-      uint64_t immediate11 = current_instruction[24] << 11;
-      uint64_t immediate10_5 = binary_return(1, 6, 0) << 5;
-      uint64_t immediate4_1 = binary_return(20, 4, 0) << 1;
-      uint64_t combined_immediate = immediate4_1 + immediate10_5 + immediate11;
-      if (current_instruction[0] == 1) {
-        combined_immediate = combined_immediate + 0xfffffffffffff000;
-      }
-      pc = pc + combined_immediate - 4;
+// The satp user-mode addresses are translated under, or 0 if they are
+// physical (machine mode, or satp MODE Bare)
+uint64_t processor::translating_satp() { return priv == 0 ? sv39_satp : 0; }
+
+void processor::update_sv39_satp() {
+  sv39_satp = (csr[0x180] >> 60) == 8 ? csr[0x180] : 0;
+}
+
+// Translate an address as the data TLB was filled (data_tlb_satp). Returns
+// false on a page fault; writable is set if a store may go straight to the
+// page.
+bool processor::translate(uint64_t address, sv39::access_type access,
+                          uint64_t& physical, bool& writable) {
+  if (data_tlb_satp == 0) {
+    physical = address;
+    writable = true;
+    return true;
+  }
+  return mmu->translate(data_tlb_satp, address, access, physical, writable);
+}
+
+// Loads and stores whose page is not in the data TLB are translated and go
+// to memory, then enter the page. Pages holding a watchpoint, pages only
+// ever read and device pages are never entered, so every access to them
+// comes this way. Returns false if the run must end after the access: a
+// page fault was raised, or a store to a device raised an interrupt, halted
+// execution or brought the next event forward, which is dealt with at the
+// end of the run.
+template <typename T>
+bool processor::load_miss(uint64_t address, T& data) {
+  data_tlb_misses++;
+  uint64_t physical;
+  bool writable;
+  if (!translate(address, sv39::ACCESS_LOAD, physical, writable)) {
+    raise_exception(13, address);
+    return false;
+  }
+  data = storage->read<T>(physical);
+  fill_data_tlb(address, physical, writable);
+  return true;
+}
+
+template <typename T>
+bool processor::store_miss(uint64_t address, T data) {
+  data_tlb_misses++;
+  uint64_t physical;
+  bool writable;
+  if (!translate(address, sv39::ACCESS_STORE, physical, writable)) {
+    raise_exception(15, address);
+    return false;
+  }
+  uint64_t next_event = events.next_time();
+  storage->write(physical, data);
+  fill_data_tlb(address, physical, writable);
+  return !interrupt_pending && events.next_time() >= next_event;
+}
+
+// The TLB serves both loads and stores, so a translated page is only
+// entered if its PTE allows both, with D already set.
+void processor::fill_data_tlb(uint64_t address, uint64_t physical,
+                              bool writable) {
+  page* p = storage->find_page(physical);
+  if (!data_tlb_fill || p == nullptr || p->watches != 0 || !writable ||
+      p->io != nullptr) {
+    return;  // the zero page must not be written through the TLB
+  }
+  storage->touch(p, physical);  // it may be written through the TLB
+  jit_tlb_entry& t = frame.tlb[(address / 4096) % jit_tlb_size];
+  t.tag = address - address % 4096;
+  if (jit_check && check_pages.count(t.tag) == 0) {
+    check_pages[t.tag].assign(p->data, p->data + 512);
+  }
+  t.data = p->data;
+  t.generation = &p->generation;
+}
+
+// Empty the fetch, data and Sv39 TLBs. Needed whenever a page they may
+// hold is remapped or freed.
+void processor::flush_tlbs() {
+  for (unsigned int t = 0; t < fetch_tlb_size; t++) {
+    fetch_tlb[t].tag = 1;  // never a page address
+  }
+  jit::flush_tlb(frame);
+  mmu->fence(0, false, 0, false);
+}
+
+// print the verbose trace of a decoded instruction
+void processor::trace_instruction(const decoded_instruction& inst) {
+  uint32_t word = inst.raw;
+  for (int i = 31; i >= 0; i--) {
+    cout << ((word >> i) & 1);
+  }
+  cout << endl;
+  cout << "opcode: ";
+  for (int i = 6; i >= 0; i--) {
+    cout << ((word >> i) & 1);
+  }
+  cout << " funct3: ";
+  for (int i = 14; i >= 12; i--) {
+    cout << ((word >> i) & 1);
+  }
+  cout << " funct7: ";
+  for (int i = 31; i >= 25; i--) {
+    cout << ((word >> i) & 1);
+  }
+  cout << endl;
+  cout << instruction_name(inst.op) << endl;
+}
+
+// Whether entries [e, end) still hold the instruction words at address
+// onwards in source
+static bool words_unchanged(const block_entry* e, const block_entry* end,
+                            const page* source, uint64_t address) {
+  for (unsigned int index = (address % 4096) / 4; e != end; ++e, ++index) {
+    uint64_t fetched = source->data[index / 2];
+    if ((uint32_t)(index % 2 ? fetched >> 32 : fetched) != e->inst.raw) {
+      return false;
     }
-  } else if (type == "BLT") {  // uns
-    // cout << "BLT" << endl;
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    if ((int)registers[register_1] < (int)registers[register_2]) {
-      uint64_t immediate11 = current_instruction[24] << 11;
-      uint64_t immediate10_5 = binary_return(1, 6, 0) << 5;
-      uint64_t immediate4_1 = binary_return(20, 4, 0) << 1;
-      uint64_t combined_immediate = immediate4_1 + immediate10_5 + immediate11;
-      if (current_instruction[0] == 1) {
-        combined_immediate = combined_immediate + 0xfffffffffffff000;
-      }
-      //  cout  << dec << "immediate: " << combined_immediate << endl;
-      pc = pc + combined_immediate - 4;
+  }
+  return true;
+}
+
+// Run count entries of a translated block with direct-threaded dispatch.
+// Each entry carries the address of its handler, so moving to the next
+// instruction is a single indirect jump. The run stops early after an
+// instruction that traps, and after a store that changes entries still to
+// run in source (the page the entries were translated from). pc is updated as if each instruction
+// had been executed one at a time. Returns the number of instructions
+// executed, which the caller adds to instruction_count.
+// Called with a null entry, it just sets up block_handlers.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+unsigned int processor::run_block(const block_entry* e, unsigned int count,
+                                  const page* source, uint64_t generation) {
+#if defined(__GNUC__)
+#define HANDLER(op) L_##op
+#define DISPATCH() goto* e->handler
+  static const void* const labels[HANDLER_COUNT] = {
+      &&L_OP_ILLEGAL, &&L_OP_LUI,    &&L_OP_AUIPC,  &&L_OP_JAL,
+      &&L_OP_JALR,    &&L_OP_BEQ,    &&L_OP_BNE,    &&L_OP_BLT,
+      &&L_OP_BGE,     &&L_OP_BLTU,   &&L_OP_BGEU,   &&L_OP_LB,
+      &&L_OP_LH,      &&L_OP_LW,     &&L_OP_LBU,    &&L_OP_LHU,
+      &&L_OP_SB,      &&L_OP_SH,     &&L_OP_SW,     &&L_OP_ADDI,
+      &&L_OP_SLTI,    &&L_OP_SLTIU,  &&L_OP_XORI,   &&L_OP_ORI,
+      &&L_OP_ANDI,    &&L_OP_SLLI,   &&L_OP_SRLI,   &&L_OP_SRAI,
+      &&L_OP_ADD,     &&L_OP_SUB,    &&L_OP_SLL,    &&L_OP_SLT,
+      &&L_OP_SLTU,    &&L_OP_XOR,    &&L_OP_SRL,    &&L_OP_SRA,
+      &&L_OP_OR,      &&L_OP_AND,    &&L_OP_FENCE,  &&L_OP_LWU,
+      &&L_OP_LD,      &&L_OP_SD,     &&L_OP_ADDIW,  &&L_OP_SLLIW,
+      &&L_OP_SRLIW,   &&L_OP_SRAIW,  &&L_OP_ADDW,   &&L_OP_SUBW,
+      &&L_OP_SLLW,    &&L_OP_SRLW,   &&L_OP_SRAW,   &&L_OP_CSRRW,
+      &&L_OP_CSRRS,   &&L_OP_CSRRC,  &&L_OP_CSRRWI, &&L_OP_CSRRSI,
+      &&L_OP_CSRRCI,  &&L_OP_ECALL,  &&L_OP_EBREAK, &&L_OP_MRET,
+      &&L_OP_SFENCE_VMA,
+      &&L_FUSED_LUI_ADDI, &&L_FUSED_LUI_ADDIW, &&L_FUSED_AUIPC_ADDI,
+      &&L_FUSED_AUIPC_JALR, &&L_FUSED_SLLI_SRLI, &&L_FUSED_SLT_BNE};
+  if (e == nullptr) {
+    block_handlers = labels;
+    return 0;
+  }
+#else
+#define HANDLER(op) case op
+#define DISPATCH() continue
+  if (e == nullptr) {
+    return 0;
+  }
+#endif
+// Move on to the next entry, or leave after this one
+#define NEXT()                \
+  pc += 4;                    \
+  if (++e == end) goto done;  \
+  DISPATCH()
+#define EXIT() \
+  pc += 4;     \
+  ++e;         \
+  goto done
+#define IMM (e->inst.imm)
+#define RD (e->inst.rd)
+#define REG1 (registers[e->inst.rs1])
+#define REG2 (registers[e->inst.rs2])
+#define BRANCH_IF(cond)   \
+  if (cond) {             \
+    pc = pc + IMM - 4;    \
+  }                       \
+  NEXT()
+// Fused pairs: the second instruction's fields, falling back to the first
+// instruction's own handler, and moving past both
+#define IMM2 (e[1].inst.imm)
+#define RD2 (e[1].inst.rd)
+#define UNFUSED_IF_LAST()        \
+  if (e + 1 == end) {            \
+    goto* labels[e->inst.op];    \
+  }
+#define PAIR_NEXT() \
+  pc += 4;          \
+  ++e;              \
+  NEXT()
+// Loads and stores hitting in the data TLB are a tag compare and an access
+// to the host page. The value is sign or zero extended by its type.
+#define LOAD(T)                                                          \
+  {                                                                      \
+    uint64_t addr = REG1 + IMM;                                          \
+    if (addr % sizeof(T) == 0) {                                         \
+      const jit_tlb_entry& t = frame.tlb[(addr / 4096) % jit_tlb_size];  \
+      T value;                                                           \
+      if (t.tag == addr - addr % 4096) {                                 \
+        data_tlb_hits++;                                                 \
+        memcpy(&value, (uint8_t*)t.data + addr % 4096, sizeof(T));       \
+      } else {                                                           \
+        make_unsigned<T>::type fetched;                                  \
+        access_offset = step_offset + (e - begin);                       \
+        if (!load_miss(addr, fetched)) {                                 \
+          EXIT();  /* page fault */                                      \
+        }                                                                \
+        value = fetched;                                                 \
+      }                                                                  \
+      set_reg(RD, (int64_t)value);                                       \
+    } else {                                                             \
+      raise_exception(4, addr);                                          \
+      EXIT();                                                            \
+    }                                                                    \
+  }                                                                      \
+  NEXT()
+#define STORE(T)                                                         \
+  {                                                                      \
+    uint64_t addr = REG1 + IMM;                                          \
+    if (addr % sizeof(T) == 0) {                                         \
+      const jit_tlb_entry& t = frame.tlb[(addr / 4096) % jit_tlb_size];  \
+      T value = REG2;                                                    \
+      if (t.tag == addr - addr % 4096) {                                 \
+        data_tlb_hits++;                                                 \
+        memcpy((uint8_t*)t.data + addr % 4096, &value, sizeof(T));       \
+        (*t.generation)++;                                               \
+      } else {                                                           \
+        access_offset = step_offset + (e - begin);                       \
+        if (!store_miss(addr, value)) {                                  \
+          EXIT();  /* page fault, interrupt, halt or new event */        \
+        }                                                                \
+      }                                                                  \
+      if (source != nullptr && source->generation != generation) {       \
+        if (!words_unchanged(e + 1, end, source, pc + 4)) {              \
+          EXIT();  /* stored into the code still to run */               \
+        }                                                                \
+        generation = source->generation;  /* only data on the page */    \
+      }                                                                  \
+    } else {                                                             \
+      raise_exception(6, addr);                                          \
+      EXIT();                                                            \
+    }                                                                    \
+  }                                                                      \
+  NEXT()
+
+  const block_entry* const begin = e;
+  const block_entry* const end = e + count;
+
+#if defined(__GNUC__)
+  DISPATCH();
+  {
+#else
+  for (;;) {
+    switch (e->inst.op) {
+#endif
+    HANDLER(OP_ILLEGAL):
+      raise_exception(2);
+      EXIT();
+    HANDLER(OP_LUI):
+      set_reg(RD, IMM);
+      NEXT();
+    HANDLER(OP_AUIPC):
+      set_reg(RD, IMM + pc);
+      NEXT();
+    HANDLER(OP_JAL):
+      set_reg(RD, pc + 4);
+      set_pc(pc + IMM - 4);
+      NEXT();
+    HANDLER(OP_JALR): {
+      uint64_t newpc = IMM + REG1 - 4;
+      newpc = newpc - (newpc % 2);
+      set_reg(RD, pc + 4);
+      set_pc(newpc);
+      NEXT();
     }
-  } else if (type == "BGE") {  // uns
-    // cout << "BGE" << endl;
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    if ((int)registers[register_1] >= (int)registers[register_2]) {
-      uint64_t immediate11 = current_instruction[24] << 11;
-      uint64_t immediate10_5 = binary_return(1, 6, 0) << 5;
-      uint64_t immediate4_1 = binary_return(20, 4, 0) << 1;
-      uint64_t combined_immediate = immediate4_1 + immediate10_5 + immediate11;
-      if (current_instruction[0] == 1) {
-        combined_immediate = combined_immediate + 0xfffffffffffff000;
+    HANDLER(OP_BEQ):
+      BRANCH_IF(REG1 == REG2);
+    HANDLER(OP_BNE):
+      BRANCH_IF(REG1 != REG2);
+    HANDLER(OP_BLT):
+      BRANCH_IF((int)REG1 < (int)REG2);
+    HANDLER(OP_BGE):
+      BRANCH_IF((int)REG1 >= (int)REG2);
+    HANDLER(OP_BLTU):
+      BRANCH_IF(REG1 < REG2);
+    HANDLER(OP_BGEU):
+      BRANCH_IF(REG1 >= REG2);
+    HANDLER(OP_LB):
+      LOAD(int8_t);
+    HANDLER(OP_LH):
+      LOAD(int16_t);
+    HANDLER(OP_LW):
+      LOAD(int32_t);
+    HANDLER(OP_LBU):
+      LOAD(uint8_t);
+    HANDLER(OP_LHU):
+      LOAD(uint16_t);
+    HANDLER(OP_LWU):
+      LOAD(uint32_t);
+    HANDLER(OP_LD):
+      LOAD(uint64_t);
+    HANDLER(OP_SB):
+      STORE(uint8_t);
+    HANDLER(OP_SH):
+      STORE(uint16_t);
+    HANDLER(OP_SW):
+      STORE(uint32_t);
+    HANDLER(OP_SD):
+      STORE(uint64_t);
+    HANDLER(OP_ADDI):
+      set_reg(RD, REG1 + IMM);
+      NEXT();
+    HANDLER(OP_SLTI):
+      set_reg(RD, (int)REG1 < (int)IMM);
+      NEXT();
+    HANDLER(OP_SLTIU):
+      set_reg(RD, REG1 < IMM);
+      NEXT();
+    HANDLER(OP_XORI):
+      set_reg(RD, REG1 ^ IMM);
+      NEXT();
+    HANDLER(OP_ORI):
+      set_reg(RD, REG1 | IMM);
+      NEXT();
+    HANDLER(OP_ANDI):
+      set_reg(RD, REG1 & IMM);
+      NEXT();
+    HANDLER(OP_SLLI):  // 64I version with 6 shamt bits
+      set_reg(RD, REG1 << IMM);
+      NEXT();
+    HANDLER(OP_SRLI):
+      set_reg(RD, REG1 >> IMM);
+      NEXT();
+    HANDLER(OP_SRAI):
+      set_reg(RD, (int64_t)REG1 >> IMM);
+      NEXT();
+    HANDLER(OP_ADD):
+      set_reg(RD, REG1 + REG2);
+      NEXT();
+    HANDLER(OP_SUB):
+      set_reg(RD, REG1 - REG2);
+      NEXT();
+    HANDLER(OP_SLL):
+      set_reg(RD, REG1 << (REG2 & 0x3f));
+      NEXT();
+    HANDLER(OP_SLT):
+      set_reg(RD, (int)REG1 < (int)REG2);
+      NEXT();
+    HANDLER(OP_SLTU):
+      set_reg(RD, REG1 < REG2);
+      NEXT();
+    HANDLER(OP_XOR):
+      set_reg(RD, REG1 ^ REG2);
+      NEXT();
+    HANDLER(OP_SRL):
+      set_reg(RD, REG1 >> (REG2 & 0x3f));
+      NEXT();
+    HANDLER(OP_SRA):
+      set_reg(RD, (int64_t)REG1 >> (REG2 & 0x3f));
+      NEXT();
+    HANDLER(OP_OR):
+      set_reg(RD, REG1 | REG2);
+      NEXT();
+    HANDLER(OP_AND):
+      set_reg(RD, REG1 & REG2);
+      NEXT();
+    HANDLER(OP_FENCE):
+      if (is_verbose) {
+        cout << "FENCE was called" << endl;
       }
-      // cout  << dec << "immediate: " << combined_immediate << endl;
-      pc = pc + combined_immediate - 4;
+      NEXT();
+    HANDLER(OP_ADDIW):
+      set_reg(RD, (int64_t)(int32_t)(REG1 + IMM));
+      NEXT();
+    HANDLER(OP_SLLIW):  // 32bit versions with 5 shamt bits
+      set_reg(RD, (int64_t)(int32_t)((uint32_t)REG1 << IMM));
+      NEXT();
+    HANDLER(OP_SRLIW):
+      set_reg(RD, (int64_t)(int32_t)((uint32_t)REG1 >> IMM));
+      NEXT();
+    HANDLER(OP_SRAIW):
+      set_reg(RD, (int64_t)((int32_t)REG1 >> IMM));
+      NEXT();
+    HANDLER(OP_ADDW):
+      set_reg(RD, (int64_t)(int32_t)((uint32_t)REG1 + (uint32_t)REG2));
+      NEXT();
+    HANDLER(OP_SUBW):
+      set_reg(RD, (int64_t)(int32_t)((uint32_t)REG1 - (uint32_t)REG2));
+      NEXT();
+    HANDLER(OP_SLLW):
+      set_reg(RD, (int64_t)(int32_t)((uint32_t)REG1 << (REG2 & 0x1f)));
+      NEXT();
+    HANDLER(OP_SRLW):
+      set_reg(RD, (int64_t)(int32_t)((uint32_t)REG1 >> (REG2 & 0x1f)));
+      NEXT();
+    HANDLER(OP_SRAW):
+      set_reg(RD, (int64_t)((int32_t)REG1 >> (REG2 & 0x1f)));
+      NEXT();
+    HANDLER(OP_CSRRW):
+    HANDLER(OP_CSRRS):
+    HANDLER(OP_CSRRC):
+    HANDLER(OP_CSRRWI):
+    HANDLER(OP_CSRRSI):
+    HANDLER(OP_CSRRCI):
+    HANDLER(OP_ECALL):
+    HANDLER(OP_EBREAK):
+    HANDLER(OP_MRET):
+    HANDLER(OP_SFENCE_VMA):
+      do_system_instruction(e->inst);
+      NEXT();
+#if defined(__GNUC__)
+    // Fused pairs. Each runs both instructions of the pair, unless the run
+    // ends between them, in which case the first runs on its own. None of
+    // the second halves can trap, so a pair retires as two instructions.
+    HANDLER(FUSED_LUI_ADDI):
+      UNFUSED_IF_LAST();
+      set_reg(RD, IMM);
+      set_reg(RD2, IMM + IMM2);
+      PAIR_NEXT();
+    HANDLER(FUSED_LUI_ADDIW):
+      UNFUSED_IF_LAST();
+      set_reg(RD, IMM);
+      set_reg(RD2, (int64_t)(int32_t)(IMM + IMM2));
+      PAIR_NEXT();
+    HANDLER(FUSED_AUIPC_ADDI):
+      UNFUSED_IF_LAST();
+      set_reg(RD, pc + IMM);
+      set_reg(RD2, pc + IMM + IMM2);
+      PAIR_NEXT();
+    HANDLER(FUSED_AUIPC_JALR): {
+      UNFUSED_IF_LAST();
+      uint64_t target = (pc + IMM + IMM2) & ~1ULL;
+      set_reg(RD, pc + IMM);
+      set_reg(RD2, pc + 8);
+      pc = target - 8;
+      PAIR_NEXT();
     }
-  } else if (type == "BLTU") {
-    // cout << "BLTU" << endl;
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    if (registers[register_1] < registers[register_2]) {
-      uint64_t immediate11 = current_instruction[24] << 11;
-      uint64_t immediate10_5 = binary_return(1, 6, 0) << 5;
-      uint64_t immediate4_1 = binary_return(20, 4, 0) << 1;
-      uint64_t combined_immediate = immediate4_1 + immediate10_5 + immediate11;
-      if (current_instruction[0] == 1) {
-        combined_immediate = combined_immediate + 0xfffffffffffff000;
-      }
-      //  cout  << dec << "immediate: " << combined_immediate << endl;
-      pc = pc + combined_immediate - 4;
+    HANDLER(FUSED_SLLI_SRLI): {
+      UNFUSED_IF_LAST();
+      uint64_t shifted = REG1 << IMM;
+      set_reg(RD, shifted);
+      set_reg(RD2, shifted >> IMM2);
+      PAIR_NEXT();
     }
-  } else if (type == "BGEU") {
-    // cout << "BGEU" << endl;
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    if (registers[register_1] >= registers[register_2]) {
-      uint64_t immediate11 = current_instruction[24] << 11;
-      uint64_t immediate10_5 = binary_return(1, 6, 0) << 5;
-      uint64_t immediate4_1 = binary_return(20, 4, 0) << 1;
-      uint64_t combined_immediate = immediate4_1 + immediate10_5 + immediate11;
-      if (current_instruction[0] == 1) {
-        combined_immediate = combined_immediate + 0xfffffffffffff000;
+    HANDLER(FUSED_SLT_BNE): {
+      UNFUSED_IF_LAST();
+      bool less = (int)REG1 < (int)REG2;
+      set_reg(RD, less);
+      if (less) {
+        pc = pc + IMM2 - 4;
       }
-      // cout  << dec << "immediate: " << combined_immediate << endl;
-      pc = pc + combined_immediate - 4;
-    }
-  } else if (type == "LB") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    int64_t addr = registers[register_1] + immediate;
-    int offset = addr % 8;
-    uint64_t buffer = storage->read_doubleword(addr);
-    buffer = (buffer >> offset * 8) & 0xFF;
-    if ((buffer >> 7) == 1) {
-      buffer = buffer + 0xffffffffffffff00;
-    }
-    // cout << "buf: " << buffer << endl;
-    set_reg(destination_reg, buffer);
-  } else if (type == "LH") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    int64_t addr = registers[register_1] + immediate;
-    int offset = addr % 8;
-    uint64_t buffer = storage->read_doubleword(addr);
-    buffer = (buffer >> offset * 8) & 0xFFFF;
-    if ((buffer >> 15) == 1) {
-      buffer = buffer + 0xffffffffffff0000;
-    }
-    if (addr % 2 == 0) {
-      // cout << "buf: " << buffer << endl;
-      set_reg(destination_reg, buffer);
-    } else {
-      raise_exception(4);
-    }
-  } else if (type == "LW") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    int64_t addr = registers[register_1] + immediate;
-    int offset = addr % 8;
-    uint64_t buffer = storage->read_doubleword(addr);
-    buffer = (buffer >> offset * 8) & 0xFFFFFFFF;
-    if ((buffer >> 31) == 1) {
-      buffer = buffer + 0xffffffff00000000;
+      PAIR_NEXT();
     }
-    if (addr % 4 == 0) {
-      // cout << "buf: " << buffer << endl;
-      set_reg(destination_reg, buffer);
-    } else {
-      raise_exception(4);
-    }
-  } else if (type == "LBU") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    int64_t addr = registers[register_1] + immediate;
-    int offset = addr % 8;
-    uint64_t buffer = storage->read_doubleword(addr);
-    buffer = (buffer >> offset * 8) & 0xFF;
-    // cout << "buf: " << buffer << endl;
-    set_reg(destination_reg, buffer);
-  } else if (type == "LHU") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    int64_t addr = registers[register_1] + immediate;
-    int offset = addr % 8;
-    uint64_t buffer = storage->read_doubleword(addr);
-    buffer = (buffer >> offset * 8) & 0xFFFF;
-    // cout << "buf: " << buffer << endl;
-    if (addr % 2 == 0) {
-      // cout << "buf: " << buffer << endl;
-      set_reg(destination_reg, buffer);
-    } else {
-      raise_exception(4);
-    }
-  } else if (type == "SB") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t immediate5_11 = binary_return(0, 7, 0) << 5;
-    uint64_t immediate4_0 = binary_return(20, 5, 0);
-    uint64_t combined_immediate = immediate4_0 + immediate5_11;
-    if (current_instruction[0] == 1) {
-      combined_immediate = combined_immediate + 0xfffffffffffff000;
-    }
-    // cout << dec << "IMM: " << (int)combined_immediate << endl;
-    uint64_t addr = combined_immediate + registers[register_1];
-    // cout << dec << "addr: " << (int)addr << endl;
-    int offset = addr % 8;
-    uint64_t buff = registers[register_2] << offset * 8;
-    uint64_t mask = 0xFFULL << (offset * 8);
-    // cout << hex << "MASK: " << mask << endl;
-    storage->write_doubleword(addr, buff, mask);
-  } else if (type == "SH") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t immediate5_11 = binary_return(0, 7, 0) << 5;
-    uint64_t immediate4_0 = binary_return(20, 5, 0);
-    uint64_t combined_immediate = immediate4_0 + immediate5_11;
-    if (current_instruction[0] == 1) {
-      combined_immediate = combined_immediate + 0xfffffffffffff000;
-    }
-    // cout << dec << "IMM: " << (int)combined_immediate << endl;
-    uint64_t addr = combined_immediate + registers[register_1];
-    // cout << dec << "addr: " << (int)addr << endl;
-    int offset = addr % 8;
-    uint64_t buff = registers[register_2] << offset * 8;
-    uint64_t mask = 0xFFFFULL << (offset * 8);
-    // cout << hex << "MASK: " << mask << endl;
-    if (addr % 2 == 0) {
-      storage->write_doubleword(addr, buff, mask);
-    } else {
-      raise_exception(6);
+  }
+#else
     }
+  }
+#endif
 
-  } else if (type == "SW") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t immediate5_11 = binary_return(0, 7, 0) << 5;
-    uint64_t immediate4_0 = binary_return(20, 5, 0);
-    uint64_t combined_immediate = immediate4_0 + immediate5_11;
-    if (current_instruction[0] == 1) {
-      combined_immediate = combined_immediate + 0xfffffffffffff000;
-    }
-    // cout << dec << "IMM: " << (int)combined_immediate << endl;
-    uint64_t addr = combined_immediate + registers[register_1];
-    // cout << dec << "addr: " << (int)addr << endl;
-    int offset = addr % 8;
-    uint64_t buff = registers[register_2] << offset * 8;
-    uint64_t mask = 0xFFFFFFFFULL << (offset * 8);
-    // cout << hex << "MASK: " << mask << endl;
-    if (addr % 4 == 0) {
-      storage->write_doubleword(addr, buff, mask);
-    } else {
-      raise_exception(6);
-    }
-  } else if (type == "ADDI") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    // cout << "IMM: " << immediate << endl;
-    immediate = immediate + registers[register_1];
-    set_reg(destination_reg, immediate);
-  } else if (type == "SLTI") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    // cout << dec << "reg1: " << (int)registers[register_1] << " imm: " <<
-    // (int)immediate << endl;
-    if ((int)registers[register_1] < (int)immediate) {
-      set_reg(destination_reg, 1);
-    } else {
-      set_reg(destination_reg, 0);
-    }
-  } else if (type == "SLTIU") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    // cout << dec << "reg1: " << (int)registers[register_1] << " imm: " <<
-    // (int)immediate << endl;
-    if (registers[register_1] < immediate) {
-      set_reg(destination_reg, 1);
-    } else {
-      set_reg(destination_reg, 0);
-    }
-  } else if (type == "XORI") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    // cout << dec << "reg1: " << (int)registers[register_1] << " imm: " <<
-    // (int)immediate << endl;
-    uint64_t buff = registers[register_1] ^ (int)immediate;
-    set_reg(destination_reg, buff);
-  } else if (type == "ORI") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    // cout << dec << "reg1: " << (int)registers[register_1] << " imm: " <<
-    // (int)immediate << endl;
-    uint64_t buff = registers[register_1] | (int)immediate;
-    set_reg(destination_reg, buff);
-  } else if (type == "ANDI") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    // cout << dec << "reg1: " << (int)registers[register_1] << " imm: " <<
-    // (int)immediate << endl;
-    uint64_t buff = registers[register_1] & (int)immediate;
-    set_reg(destination_reg, buff);
-  } else if (type == "SLLI") {  // 64I version with 6 shamt bits
-    uint64_t shamt = binary_return(6, 6, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    set_reg(destination_reg, registers[register_1] << shamt);
-  } else if (type == "SRLI") {  // 64I version with 6 shamt bits
-    uint64_t shamt = binary_return(6, 6, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    set_reg(destination_reg, registers[register_1] >> shamt);
-  } else if (type == "SRAI") {  // 64I version with 6 shamt bits
-    uint64_t shamt = binary_return(6, 6, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    // cout << hex <<"REG: " << (int)registers[register_1] << endl;
-    // cout << "SHAMT: " << shamt << endl;
-    set_reg(destination_reg, (long int)registers[register_1] >> shamt);
-  } else if (type == "ADD") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t buffer = registers[register_1] + registers[register_2];
-    set_reg(destination_reg, buffer);
-  } else if (type == "SUB") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t buffer = registers[register_1] - registers[register_2];
-    set_reg(destination_reg, buffer);
-  } else if (type == "SLL") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t shamt = registers[register_2] & 0x3f;
-    uint64_t buff = registers[register_1] << shamt;
-    set_reg(destination_reg, buff);
-
-  } else if (type == "SLT") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    if ((int)registers[register_1] < (int)registers[register_2]) {
-      set_reg(destination_reg, 1);
-    } else {
-      set_reg(destination_reg, 0);
-    }
-  } else if (type == "SLTU") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    if (registers[register_1] < registers[register_2]) {
-      set_reg(destination_reg, 1);
-    } else {
-      set_reg(destination_reg, 0);
-    }
-  } else if (type == "XOR") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t buff = registers[register_1] ^ registers[register_2];
-    set_reg(destination_reg, buff);
-  } else if (type == "SRL") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t shamt = registers[register_2] & 0x3f;
-    uint64_t buff = registers[register_1] >> shamt;
-    set_reg(destination_reg, buff);
-  } else if (type == "SRA") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t shamt = registers[register_2] & 0x3f;
-    uint64_t buff = (long int)registers[register_1] >> shamt;
-    set_reg(destination_reg, buff);
-  } else if (type == "OR") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t buff = registers[register_1] | registers[register_2];
-    set_reg(destination_reg, buff);
-  } else if (type == "AND") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t buff = registers[register_1] & registers[register_2];
-    set_reg(destination_reg, buff);
-  } else if (type == "FENCE") {
-    if (is_verbose) {
-      cout << "FENCE was called" << endl;
-    }
-  } else if (type == "LWU") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    int64_t addr = registers[register_1] + immediate;
-    int offset = addr % 8;
-    uint64_t buffer = storage->read_doubleword(addr);
-    buffer = (buffer >> offset * 8) & 0xFFFFFFFF;
-    // cout << "buf: " << buffer << endl;
-    if (addr % 4 == 0) {
-      // cout << "buf: " << buffer << endl;
-      set_reg(destination_reg, buffer);
-    } else {
-      raise_exception(4);
-    }
-  } else if (type == "LD") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    int64_t addr = registers[register_1] + immediate;
-    uint64_t buffer = storage->read_doubleword(addr);
-    if (addr % 8 == 0) {
-      // cout << "buf: " << buffer << endl;
-      set_reg(destination_reg, buffer);
-    } else {
-      raise_exception(4);
-    }
-  } else if (type == "SD") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t immediate5_11 = binary_return(0, 7, 0) << 5;
-    uint64_t immediate4_0 = binary_return(20, 5, 0);
-    uint64_t combined_immediate = immediate4_0 + immediate5_11;
-    if (current_instruction[0] == 1) {
-      combined_immediate = combined_immediate + 0xfffffffffffff000;
-    }
-    // cout << dec << "IMM: " << (int)combined_immediate << endl;
-    uint64_t addr = combined_immediate + registers[register_1];
-    // cout << dec << "addr: " << (int)addr << endl;
-    uint64_t buff = registers[register_2];
-    // cout << hex << "MASK: " << mask << endl;
-    if (addr % 8 == 0) {
-      storage->write_doubleword(addr, buff, 0xffffffffffffffff);
-    } else {
-      raise_exception(6);
-    }
-  } else if (type == "ADDIW") {
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    // cout << hex <<"imm: " << immediate << " register: " <<
-    // registers[register_1] <<  endl;
-    int result = immediate + registers[register_1];
-    //  cout << hex <<"res: " << result << endl;
-    set_reg(destination_reg, result);
-  }
-  // I think i can change SLLIW and SRLIW using cast to int32_t like SRAIW, will
-  // look
-  else if (type == "SLLIW") {  // 32bit version with 5 shamt bits
-    uint64_t shamt = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t buff = (registers[register_1] & 0x00000000ffffffff) << shamt;
-    // cout << "BUFF: " << buff << endl;
-    if ((buff & 0xffffffff) >> 31 == 1) {
-      buff = 0xffffffff00000000 | buff;
-    } else {
-      buff = buff & 0x00000000ffffffff;
-    }
-    set_reg(destination_reg, buff);
-  } else if (type == "SRLIW") {  // 32bit version with 5 shamt bits
-    uint64_t shamt = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t buff = (registers[register_1] & 0x00000000ffffffff) >> shamt;
-    // cout << "BUFF: " << buff << endl;
-    if ((buff & 0xffffffff) >> 31 == 1) {
-      buff = 0xffffffff00000000 | buff;
-    } else {
-      buff = buff & 0x00000000ffffffff;
-    }
-    set_reg(destination_reg, buff);
-  } else if (type == "SRAIW") {  // 32bit version with 5 shamt bits
-    uint64_t shamt = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t buff = (int32_t)registers[register_1] >> shamt;
-    // cout << "BUFF: " << buff << endl;
-    set_reg(destination_reg, buff);
-  } else if (type == "ADDW") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t buffer =
-        (int32_t)registers[register_1] + (int32_t)registers[register_2];
-    set_reg(destination_reg, buffer);
-  } else if (type == "SUBW") {
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t buffer =
-        (int32_t)registers[register_1] - (int32_t)registers[register_2];
-    set_reg(destination_reg, buffer);
-  } else if (type == "SLLW") {  // 32bit version with 5 shamt bits
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t shamt = registers[register_2] & 0x1f;
-    uint64_t buff = (registers[register_1] & 0x00000000ffffffff) << shamt;
-    // cout << "BUFF: " << buff << endl;
-    if ((buff & 0xffffffff) >> 31 == 1) {
-      buff = 0xffffffff00000000 | buff;
-    } else {
-      buff = buff & 0x00000000ffffffff;
-    }
-    set_reg(destination_reg, buff);
-  } else if (type == "SRLW") {  // 32bit version with 5 shamt bits
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t shamt = registers[register_2] & 0x1f;
-    uint64_t buff = (registers[register_1] & 0x00000000ffffffff) >> shamt;
-    // cout << "BUFF: " << buff << endl;
-    if ((buff & 0xffffffff) >> 31 == 1) {
-      buff = 0xffffffff00000000 | buff;
-    } else {
-      buff = buff & 0x00000000ffffffff;
-    }
-    set_reg(destination_reg, buff);
-  } else if (type == "SRAW") {  // 32bit version with 5 shamt bits
-    uint64_t register_2 = binary_return(7, 5, 0);
-    uint64_t shamt = registers[register_2] & 0x1f;
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t buff = (int32_t)registers[register_1] >> shamt;
-    // cout << "BUFF: " << buff << endl;
-    set_reg(destination_reg, buff);
-  }
-  // ZICSR EXTENSION ISA
-  if (type == "CSRRW") {
-    uint64_t csr_num = binary_return(0, 12, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    if (illegal_csr(csr_num, register_1)) {
-      uint64_t buffer = registers[register_1];
-      set_reg(destination_reg, csr[csr_num]);
-      if (csr_num != 0xf11 && csr_num != 0xf12 && csr_num != 0xf13 &&
-          csr_num != 0xf14) {
-        if (csr_num == 0x344) {  // Mxxx cannot be written through csr inst
-          buffer = buffer & 0x111;
-        }
-        set_csr(csr_num, buffer);
-      }
-    } else {
-      raise_exception(2);
-    }
-  } else if (type == "CSRRS") {
-    uint64_t csr_num = binary_return(0, 12, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    if (illegal_csr(csr_num, register_1)) {
-      uint64_t buffer = registers[register_1] | csr[csr_num];
-      set_reg(destination_reg, csr[csr_num]);
-      if (csr_num != 0xf11 && csr_num != 0xf12 && csr_num != 0xf13 &&
-          csr_num != 0xf14) {
-        if (csr_num == 0x344) {  // Mxxx cannot be written through csr inst
-          buffer = buffer & 0x111;
-        }
-        set_csr(csr_num, buffer);
-      }
-    } else {
-      raise_exception(2);
-    }
-  } else if (type == "CSRRC") {
-    uint64_t csr_num = binary_return(0, 12, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    if (illegal_csr(csr_num, register_1)) {
-      uint64_t buffer = (~registers[register_1]) & csr[csr_num];
-      set_reg(destination_reg, csr[csr_num]);
-      if (csr_num != 0xf11 && csr_num != 0xf12 && csr_num != 0xf13 &&
-          csr_num != 0xf14) {
-        if (csr_num == 0x344) {  // Mxxx cannot be written through csr inst
-          buffer = buffer & 0x111;
+done:
+  access_offset = 0;
+  return e - begin;
+
+#undef HANDLER
+#undef DISPATCH
+#undef NEXT
+#undef EXIT
+#undef IMM
+#undef RD
+#undef REG1
+#undef REG2
+#undef BRANCH_IF
+#undef IMM2
+#undef RD2
+#undef UNFUSED_IF_LAST
+#undef PAIR_NEXT
+#undef LOAD
+#undef STORE
+}
+#pragma GCC diagnostic pop
+
+// do a Zicsr or privileged instruction
+void processor::do_system_instruction(const decoded_instruction& inst) {
+  const uint64_t imm = inst.imm;
+  const unsigned int rd = inst.rd;
+  const uint64_t reg1 = registers[inst.rs1];
+
+  switch (inst.op) {
+    // ZICSR EXTENSION ISA
+    case OP_CSRRW:
+    case OP_CSRRS:
+    case OP_CSRRC: {
+      uint64_t csr_num = imm;
+      if (illegal_csr(csr_num, inst.rs1)) {
+        uint64_t buffer = reg1;
+        if (inst.op == OP_CSRRS) buffer = reg1 | csr[csr_num];
+        if (inst.op == OP_CSRRC) buffer = (~reg1) & csr[csr_num];
+        set_reg(rd, csr[csr_num]);
+        if (csr_num != 0xf11 && csr_num != 0xf12 && csr_num != 0xf13 &&
+            csr_num != 0xf14) {
+          if (csr_num == 0x344) {  // Mxxx cannot be written through csr inst
+            buffer = buffer & 0x111;
+          }
+          set_csr(csr_num, buffer);
         }
-        set_csr(csr_num, buffer);
+      } else {
+        raise_exception(2);
       }
-    } else {
-      raise_exception(2);
+      break;
     }
-  } else if (type == "CSRRWI") {
-    uint64_t csr_num = binary_return(0, 12, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t immediate = binary_return(12, 5, 0);
-    // cout << hex <<"IMM: " << immediate << endl;
-    if (illegal_csr_imm(csr_num)) {
-      set_reg(destination_reg, csr[csr_num]);
-      if (csr_num != 0xf11 && csr_num != 0xf12 && csr_num != 0xf13 &&
-          csr_num != 0xf14) {
-        if (csr_num == 0x344) {  // Mxxx cannot be written through csr inst
-          immediate = immediate & 0x111;
+    case OP_CSRRWI:
+    case OP_CSRRSI:
+    case OP_CSRRCI: {
+      uint64_t csr_num = imm;
+      uint64_t immediate = inst.rs1;
+      uint64_t buffer = immediate;
+      if (inst.op == OP_CSRRSI) buffer = immediate | csr[csr_num];
+      if (inst.op == OP_CSRRCI) buffer = (~immediate) & csr[csr_num];
+      if (illegal_csr_imm(csr_num)) {
+        set_reg(rd, csr[csr_num]);
+        if (csr_num != 0xf11 && csr_num != 0xf12 && csr_num != 0xf13 &&
+            csr_num != 0xf14) {
+          if (csr_num == 0x344) {  // Mxxx cannot be written through csr inst
+            buffer = buffer & 0x111;
+          }
+          set_csr(csr_num, buffer);
         }
-        set_csr(csr_num, immediate);
+      } else {
+        raise_exception(2);
       }
-    } else {
-      raise_exception(2);
+      break;
     }
-  } else if (type == "CSRRSI") {
-    uint64_t csr_num = binary_return(0, 12, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t immediate = binary_return(12, 5, 0);
-    uint64_t buffer = immediate | csr[csr_num];
-    if (illegal_csr_imm(csr_num)) {
-      set_reg(destination_reg, csr[csr_num]);
-      if (csr_num != 0xf11 && csr_num != 0xf12 && csr_num != 0xf13 &&
-          csr_num != 0xf14) {
-        if (csr_num == 0x344) {  // Mxxx cannot be written through csr inst
-          buffer = buffer & 0x111;
-        }
-        set_csr(csr_num, buffer);
+    case OP_ECALL:
+      if (priv == 0) {
+        raise_exception(8);
+      } else if (priv == 3) {
+        raise_exception(11);
+      } else {
+        cout << "ecall error" << endl;
       }
-    } else {
-      raise_exception(2);
-    }
-  } else if (type == "CSRRCI") {
-    uint64_t csr_num = binary_return(0, 12, 0);
-    uint64_t destination_reg = binary_return(20, 5, 0);
-    uint64_t immediate = binary_return(12, 5, 0);
-    uint64_t buffer = (~immediate) & csr[csr_num];
-    if (illegal_csr_imm(csr_num)) {
-      set_reg(destination_reg, csr[csr_num]);
-      if (csr_num != 0xf11 && csr_num != 0xf12 && csr_num != 0xf13 &&
-          csr_num != 0xf14) {
-        if (csr_num == 0x344) {  // Mxxx cannot be written through csr inst
-          buffer = buffer & 0x111;
-        }
-        set_csr(csr_num, buffer);
+      break;
+    case OP_EBREAK:
+      // mepc = pc
+      set_csr(0x341, pc);
+
+      // mtvec
+      if (csr[0x305] & 0x1) {  // vectored (set pc to BASE+4×cause.)
+        uint64_t base = (csr[0x305] & 0xfffffffffffffffc);
+        pc = base + (4 * (csr[0x342]) & 0x8000000000000000) - 4;
+      } else {  // unvectored (All traps set pc to BASE.)
+        pc = (csr[0x305] & 0xfffffffffffffffc) - 4;
       }
-    } else {
-      raise_exception(2);
-    }
-  } else if (type == "ECALL") {
-    if (priv == 0) {
-      raise_exception(8);
-    } else if (priv == 3) {
-      raise_exception(11);
-    } else {
-      cout << "ecall error" << endl;
-    }
-  } else if (type == "EBREAK") {
-    // mepc = pc
-    set_csr(0x341, pc);
-
-    // mtvec
-    if (csr[0x305] & 0x1) {  // vectored (set pc to BASE+4×cause.)
-      uint64_t base = (csr[0x305] & 0xfffffffffffffffc);
-      pc = base + (4 * (csr[0x342]) & 0x8000000000000000) - 4;
-    } else {  // unvectored (All traps set pc to BASE.)
-      pc = (csr[0x305] & 0xfffffffffffffffc) - 4;
-    }
 
-    // mcause
-    set_csr(0x342, 3);
+      // mcause
+      set_csr(0x342, 3);
 
-    // mstatus
-    // set mpp (in mstatus)
-    if (priv == 0) {                                    // user mode
-      set_csr(0x300, csr[0x300] & 0xffffffffffffe7ff);  // set mpp
-    } else if (priv == 3) {                             // machine mode
-      set_csr(0x300, csr[0x300] | 0x1800);
-    }
+      // mstatus
+      // set mpp (in mstatus)
+      if (priv == 0) {                                    // user mode
+        set_csr(0x300, csr[0x300] & 0xffffffffffffe7ff);  // set mpp
+      } else if (priv == 3) {                             // machine mode
+        set_csr(0x300, csr[0x300] | 0x1800);
+      }
 
-    // set mpie (in mstatus)
-    if (csr[0x300] & 0x8) {  // if mpie was 1 before
-      set_csr(0x300, csr[0x300] | 0x0000000000000080);
-    } else {  // if mpie was 0
-      set_csr(0x300, csr[0x300] & 0xfffffffffffffff7);
-    }
+      // set mpie (in mstatus)
+      if (csr[0x300] & 0x8) {  // if mpie was 1 before
+        set_csr(0x300, csr[0x300] | 0x0000000000000080);
+      } else {  // if mpie was 0
+        set_csr(0x300, csr[0x300] & 0xfffffffffffffff7);
+      }
 
-    // set mie (in mstatus)
-    set_csr(0x300, csr[0x300] & 0xfffffffffffffff7);
+      // set mie (in mstatus)
+      set_csr(0x300, csr[0x300] & 0xfffffffffffffff7);
 
-    priv = 3;
-    instruction_count--;  // for some reason, calling an exception = error
-  } else if (type == "MRET") {
-    if (priv == 0) {  // if mret during user priv, exception
-      raise_exception(2);
-    } else {
-      set_pc(csr[0x341] - 4);  // return pc
+      priv = 3;
+      update_interrupt_pending();
+      instruction_count--;  // for some reason, calling an exception = error
+      break;
+    case OP_MRET:
+      if (priv == 0) {  // if mret during user priv, exception
+        raise_exception(2);
+      } else {
+        set_pc(csr[0x341] - 4);  // return pc
 
-      priv = (csr[0x300] >> 11) & 0x3;  // set priv to mpp
+        priv = (csr[0x300] >> 11) & 0x3;  // set priv to mpp
+        update_interrupt_pending();
 
-      uint64_t buff = (csr[0x300] & 0x80) >> 4;  // extract MPIE
-      set_csr(0x300, (csr[0x300] & 0xffffffffffffe777) | (0x80 | buff));
-    }
+        uint64_t buff = (csr[0x300] & 0x80) >> 4;  // extract MPIE
+        set_csr(0x300, (csr[0x300] & 0xffffffffffffe777) | (0x80 | buff));
+      }
+      break;
+    case OP_SFENCE_VMA:
+      // rs1 selects one address and rs2 one ASID; x0 selects all
+      if (priv == 0) {
+        raise_exception(2);
+      } else {
+        mmu->fence(reg1, inst.rs1 != 0, registers[inst.rs2] & 0xffff,
+                   inst.rs2 != 0);
+        jit::flush_tlb(frame);  // it may hold pages of the old mappings
+      }
+      break;
+    default:
+      break;
   }
 }
 
-void processor::raise_exception(int cause) {
+void processor::raise_exception(int cause, uint64_t tval) {
   uint64_t og_pc = pc;
   set_csr(0x341, pc);     // set mepc to pc
   set_csr(0x342, cause);  // set mcause to cause
@@ -964,39 +755,34 @@ void processor::raise_exception(int cause) {
   uint64_t buff2 = csr[0x300] & 0xffffffffffffe777;
   set_csr(0x300, buff2 | (priv << 11 | buff << 4));
 
-  if (cause == 0) {  // misaligned instruction
+  if (cause == 0 || cause == 12) {  // misaligned instruction, fetch fault
     set_csr(0x343, og_pc);
     instruction_count++;
     pc = pc + 4;
   }
 
   if (cause == 2) {  // illegal instruction
-    set_csr(0x343, curr_inst);
+    // low word of the doubleword holding the instruction, as fetched
+    set_csr(0x343, (uint32_t)storage->read_doubleword(og_pc));
   }
 
-  if (cause == 4) {  // misaligned load
-    uint64_t immediate = binary_return(0, 12, 1);
-    uint64_t register_1 = binary_return(12, 5, 0);
-    int64_t addr = registers[register_1] + immediate;
-    set_csr(0x343, addr);
-  }
-
-  if (cause == 6) {  // misaligned store
-    uint64_t register_1 = binary_return(12, 5, 0);
-    uint64_t immediate5_11 = binary_return(0, 7, 0) << 5;
-    uint64_t immediate4_0 = binary_return(20, 5, 0);
-    uint64_t combined_immediate = immediate4_0 + immediate5_11;
-    if (current_instruction[0] == 1) {
-      combined_immediate = combined_immediate + 0xfffffffffffff000;
-    }
-    uint64_t addr = combined_immediate + registers[register_1];
-    set_csr(0x343, addr);
+  if (cause == 4 || cause == 6) {  // misaligned load / store
+    set_csr(0x343, tval);
   }
 
   if (cause == 8 || cause == 11) {
     priv = 3;
+    update_interrupt_pending();
     set_csr(0x343, 0);
   }
+
+  if (cause == 12 || cause == 13 || cause == 15) {  // page faults
+    if (cause != 12) {
+      set_csr(0x343, tval);
+    }
+    priv = 3;
+    update_interrupt_pending();
+  }
   instruction_count--;
 }
 // Display PC value
@@ -1026,15 +812,64 @@ void processor::set_reg(unsigned int reg_num, uint64_t new_value) {
 }
 
 // Execute a number of instructions
+// The modes that stay fixed for the whole run are tested once here, to pick
+// a loop specialised for them.
 void processor::execute(unsigned int num, bool breakpoint_check) {
-  for (unsigned int i = 0; i < num; i++) {
-    if (breakpoint_check && (pc == breakpoint)) {
+  typedef void (processor::*execute_loop)(unsigned int);
+  static const execute_loop loops[8] = {
+      &processor::run<false, false, false>, &processor::run<false, false, true>,
+      &processor::run<false, true, false>,  &processor::run<false, true, true>,
+      &processor::run<true, false, false>,  &processor::run<true, false, true>,
+      &processor::run<true, true, false>,   &processor::run<true, true, true>};
+  bool stopping = breakpoint_check && !breakpoints.empty();
+  bool watching = storage->watching();
+  uint64_t watch_address;
+  unsigned int watch_kind;
+  storage->take_watch_hit(watch_address, watch_kind);  // hits made by commands
+  (this->*loops[4 * is_verbose + 2 * stopping + watching])(num);
+  storage->flush_devices();  // console output before the next command's
+}
+
+// Report a watched access made by the last instruction run, if any
+bool processor::watch_reached() {
+  uint64_t watch_address;
+  unsigned int watch_kind;
+  if (!storage->take_watch_hit(watch_address, watch_kind)) {
+    return false;
+  }
+  cout << "Watchpoint reached at ";
+  cout << setw(16) << setfill('0') << hex << watch_address;
+  cout << (watch_kind == memory::WATCH_READ ? " (read)" : " (write)") << endl;
+  return true;
+}
+
+// The execute loop for one combination of modes:
+//   verbose   trace and run one instruction at a time
+//   stopping  stop on breakpoints
+//   watching  stop after an access to a watched doubleword, running one
+//             instruction at a time
+// Otherwise work is done a translated block at a time. The breakpoint
+// lookup, the event and interrupt checks and the pc alignment check are made
+// once per block; a block is cut short so that it never runs past the
+// instruction count, the next event or onto a breakpoint.
+template <bool verbose, bool stopping, bool watching>
+void processor::run(unsigned int num) {
+  basic_block* previous = nullptr;  // last block run to its end
+  unsigned int i = 0;
+  while (i < num) {
+    if (stopping && breakpoint_reached()) {
       cout << "Breakpoint reached at ";
-      cout << setw(16) << setfill('0') << hex << breakpoint << endl;
+      cout << setw(16) << setfill('0') << hex << pc << endl;
       break;
     }
+    if (instruction_count >= events.next_time()) {
+      events.run(instruction_count);  // a timer deadline, say
+    }
     // interrupt catcher
-    if ((csr[0x300] & 0x8) || (priv == 0)) {
+    if (interrupt_pending) {
+      if (halted) {
+        break;
+      }
       // 0x344 = mip, 0x304 = mie
       if ((csr[0x344] & 0x800) && (csr[0x304] & 0x800)) {  // meip, meie
         cause_interrupt(11);  // machine external interrupt
@@ -1053,28 +888,529 @@ void processor::execute(unsigned int num, bool breakpoint_check) {
     if (pc % 4 != 0) {
       raise_exception(0);
       // cout << "Error: misaligned pc" << endl;
+      previous = nullptr;
+      i++;
       continue;
     }
-    load_instruction(storage->read_doubleword(pc), pc);
-   // cout << setw(16) << setfill('0') << hex << storage->read_doubleword(pc)
-   //      << endl;
-    string type = instruction_type();
-   // cout << "Type: " << type << endl;
-   // cout << "pc og: ";
-   // show_pc();
-    do_instruction(type);
-   // cout << "pc new: ";
-  //  show_pc();
-    instruction_count++;
-    pc = pc + 4;
+    // The data TLB holds the pages of one address space at a time
+    uint64_t satp = translating_satp();
+    if (satp != data_tlb_satp) {
+      jit::flush_tlb(frame);
+      data_tlb_satp = satp;
+    }
+    uint64_t address = pc;  // physical address of the next instruction
+    bool writable;
+    if (satp != 0 &&
+        !mmu->translate(satp, pc, sv39::ACCESS_FETCH, address, writable)) {
+      raise_exception(12);
+      previous = nullptr;
+      i++;
+      continue;
+    }
+    if (verbose) {  // trace one instruction at a time
+      block_entry single;
+      single.inst = fetch(address);
+      single.handler = block_handlers ? block_handlers[single.inst.op] : nullptr;
+      trace_instruction(single.inst);
+      instruction_count += run_block(&single, 1, nullptr, 0);
+      i++;
+      if (watching && watch_reached()) {
+        break;
+      }
+      continue;
+    }
+
+    // Follow the chain from the previous block if it leads here. Blocks
+    // are by physical address, so with translation on their successors
+    // are only followed when the target is mapped where they assumed.
+    basic_block* block = nullptr;
+    if (previous != nullptr) {
+      for (unsigned int s = 0; s < previous->successors; s++) {
+        if (previous->successor_pc[s] == address) {
+          if (previous->successor[s] == nullptr) {
+            previous->successor[s] = lookup_block(address);
+          }
+          block = previous->successor[s];
+        }
+      }
+    }
+    if (block == nullptr) {
+      block = lookup_block(address);
+    }
+    if (block->source->generation != block->generation) {
+      revalidate_block(block);  // the page was written since translation
+    }
+
+    unsigned int count = watching ? 1 : block->entries.size();
+    if (count > num - i) {
+      count = num - i;
+    }
+    if (count > events.next_time() - instruction_count) {
+      count = events.next_time() - instruction_count;  // stop at the event
+    }
+    if (stopping && satp != 0) {
+      count = 1;  // breakpoints are by virtual address
+    } else if (stopping && breakpoint_index(block) < count) {
+      count = block->breakpoint_stop;  // stop on the breakpoint
+    }
+    unsigned int done;
+    if (block->native != nullptr && count == block->entries.size() &&
+        satp == 0) {  // native code assumes physical addresses
+      frame.block = block;
+      done = jit_check ? run_checked(block) : block->native(&frame);
+    } else {
+      done = run_block(&block->entries[0], count, block->source,
+                       block->generation);
+      if (compiler != nullptr && done == block->entries.size() &&
+          ++block->executions == jit_threshold) {
+        compile_block(block);
+      }
+    }
+    instruction_count += done;
+    i += done;
+    previous = (done == block->entries.size()) ? block : nullptr;
+    if (watching && watch_reached()) {
+      break;
+    }
+  }
+}
+
+// Find the translated block starting at address, translating it if needed
+basic_block* processor::lookup_block(uint64_t address) {
+  unique_ptr<basic_block>& found = blocks[address];
+  if (!found) {
+    found.reset(new basic_block());
+    found->start = address;
+    translate_block(found.get());
+  }
+  return found.get();
+}
+
+// Bring block up to its page's generation. Stores to data sharing a code
+// page move the page on too, so the block is kept (with its fused pairs and
+// native code) when its instruction words are unchanged.
+void processor::revalidate_block(basic_block* block) {
+  const block_entry* begin = block->entries.data();
+  if (words_unchanged(begin, begin + block->entries.size(), block->source,
+                      block->start)) {
+    block->generation = block->source->generation;
+  } else {
+    translate_block(block);
+  }
+}
+
+// Translate the straight-line run of instructions from block->start up to
+// and including the first control transfer, trapping or CSR instruction.
+// Blocks never cross a page, so one generation check covers all entries.
+void processor::translate_block(basic_block* block) {
+  page* source = code_page(block->start);
+  block->source = source;
+  block->generation = source->generation;
+  block->entries.clear();
+  block->successors = 0;
+  block->successor[0] = nullptr;
+  block->successor[1] = nullptr;
+  block->executions = 0;
+  block->native = nullptr;
+  block->breakpoint_epoch = 0;
+
+  uint64_t address = block->start;
+  bool terminated = false;
+  while (!terminated) {
+    block_entry entry;
+    entry.inst = predecode(source, address);
+    entry.handler = block_handlers ? block_handlers[entry.inst.op] : nullptr;
+    block->entries.push_back(entry);
+
+    switch (entry.inst.op) {
+      case OP_BEQ:
+      case OP_BNE:
+      case OP_BLT:
+      case OP_BGE:
+      case OP_BLTU:
+      case OP_BGEU:
+        block->successor_pc[block->successors++] = address + entry.inst.imm;
+        block->successor_pc[block->successors++] = address + 4;
+        break;
+      case OP_JAL:
+        block->successor_pc[block->successors++] = address + entry.inst.imm;
+        break;
+      default:
+        break;
+    }
+    terminated = ends_block(entry.inst.op);
+    address += 4;
+    if (!terminated &&
+        (address % 4096 == 0 || block->entries.size() == max_block_length)) {
+      block->successor_pc[block->successors++] = address;
+      terminated = true;
+    }
+  }
+  if (fusion && block_handlers) {
+    fuse_pairs(block);
+  }
+  if (translation) {
+    block->native = translation->lookup(block);
+  }
+}
+
+// Point the first entry of each fusible pair at the fused handler. The
+// second instruction must use the first's result (and the result must not
+// be x0). A pair never overlaps another.
+void processor::fuse_pairs(basic_block* block) {
+  vector<block_entry>& entries = block->entries;
+  for (unsigned int k = 0; k + 1 < entries.size(); k++) {
+    const decoded_instruction& first = entries[k].inst;
+    const decoded_instruction& second = entries[k + 1].inst;
+    if (first.rd == 0) {
+      continue;
+    }
+    int fused = -1;
+    if (second.rs1 == first.rd) {
+      if (first.op == OP_LUI && second.op == OP_ADDI) fused = FUSED_LUI_ADDI;
+      if (first.op == OP_LUI && second.op == OP_ADDIW) fused = FUSED_LUI_ADDIW;
+      if (first.op == OP_AUIPC && second.op == OP_ADDI) fused = FUSED_AUIPC_ADDI;
+      if (first.op == OP_AUIPC && second.op == OP_JALR) fused = FUSED_AUIPC_JALR;
+      if (first.op == OP_SLLI && second.op == OP_SRLI) fused = FUSED_SLLI_SRLI;
+    }
+    if (first.op == OP_SLT && second.op == OP_BNE &&
+        ((second.rs1 == first.rd && second.rs2 == 0) ||
+         (second.rs2 == first.rd && second.rs1 == 0))) {
+      fused = FUSED_SLT_BNE;
+    }
+    if (fused >= 0) {
+      entries[k].handler = block_handlers[fused];
+      fused_pairs++;
+      k++;
+    }
+  }
+}
+
+// Turn on compilation of hot blocks to native code. In self-check mode
+// every native run is compared against the interpreter.
+void processor::enable_jit(bool self_check) {
+  compiler.reset(new jit());
+  if (!compiler->available()) {
+    cout << "JIT not available on this host, interpreting" << endl;
+    compiler.reset();
+    return;
+  }
+  jit_check = self_check;
+}
+
+// Translate every image loaded from now on ahead of time
+void processor::enable_aot(string directory) {
+  translation.reset(new aot(directory, is_verbose));
+}
+
+// Translate the image just loaded, starting from pc and the trap vector.
+// Blocks translated earlier pick the new code up, or drop stale code.
+void processor::translate_image() {
+  if (!translation) {
+    return;
+  }
+  vector<uint64_t> roots;
+  roots.push_back(pc);
+  uint64_t vector_base = csr[0x305] & 0xfffffffffffffffc;
+  roots.push_back(vector_base);
+  if (csr[0x305] & 0x1) {  // vectored: one entry per interrupt cause
+    for (unsigned int cause = 0; cause < 12; cause++) {
+      roots.push_back(vector_base + 4 * cause);
+    }
+  }
+  translation->prepare(storage, roots);
+  for (auto& b : blocks) {
+    b.second->native = translation->lookup(b.second.get());
+  }
+}
+
+// Compile a block that has become hot. When the code buffer is full, all
+// native code is dropped and blocks are compiled again as they are run.
+void processor::compile_block(basic_block* block) {
+  block->native = compiler->compile(block, jit_step);
+  if (block->native == nullptr) {
+    compiler->reset();
+    for (auto& b : blocks) {
+      b.second->native =
+          translation ? translation->lookup(b.second.get()) : nullptr;
+    }
+    block->native = compiler->compile(block, jit_step);
+  }
+  if (block->native != nullptr) {
+    jit_compiled++;
+  }
+}
+
+// Step helper for native code: run one entry of block in the interpreter.
+// Loads and stores come here when their page is not in the data TLB (or the
+// access is misaligned); the interpreter enters the page, so the next
+// access takes the fast path.
+unsigned int processor::jit_step(void* cpu, const basic_block* block,
+                                 unsigned int index) {
+  processor* p = (processor*)cpu;
+  uint64_t address = block->start + 4 * index;
+
+  p->pc = address;
+  p->step_offset = index;
+  p->run_block(&block->entries[index], 1, block->source, block->generation);
+  p->step_offset = 0;
+  const block_entry* rest = block->entries.data() + index + 1;
+  const block_entry* end = block->entries.data() + block->entries.size();
+  if (p->pc != address + 4 ||
+      (block->source->generation != block->generation &&
+       !words_unchanged(rest, end, block->source, address + 4)) ||
+      p->interrupt_pending ||
+      p->events.next_time() < p->instruction_count + block->entries.size()) {
+    return 1;  // trapped, changed the rest of the block, interrupted, or
+               // brought an event forward into the block
+  }
+  return 0;
+}
+
+// Run a compiled block in self-check mode. The block is first run in the
+// interpreter with its output suppressed; its effects are recorded and
+// undone, and the native code is run from the same state. Any difference
+// is reported, and the interpreter's results are kept.
+unsigned int processor::run_checked(basic_block* block) {
+  vector<uint64_t> start_registers = registers;
+  uint64_t start_pc = pc;
+  unordered_map<uint64_t, uint64_t> start_csr = csr;
+  int start_priv = priv;
+  uint64_t start_count = instruction_count;
+
+  // Interpreter
+  vector<pair<uint64_t, uint64_t>> interpreted_writes;
+  // Every access must miss the data TLB, so that stores are journaled
+  jit_tlb_entry start_tlb[jit_tlb_size];
+  copy(frame.tlb, frame.tlb + jit_tlb_size, start_tlb);
+  jit::flush_tlb(frame);
+  data_tlb_fill = false;
+  streambuf* output = cout.rdbuf(nullptr);
+  storage->begin_journal();
+  unsigned int expected_done = run_block(&block->entries[0],
+                                         block->entries.size(), block->source,
+                                         block->generation);
+  storage->end_journal(interpreted_writes);
+  cout.rdbuf(output);
+  data_tlb_fill = true;
+  copy(start_tlb, start_tlb + jit_tlb_size, frame.tlb);
+  vector<uint64_t> expected_registers = registers;
+  uint64_t expected_pc = pc;
+  unordered_map<uint64_t, uint64_t> expected_csr = csr;
+  int expected_priv = priv;
+  uint64_t expected_count = instruction_count + expected_done;
+  unordered_map<uint64_t, uint64_t> expected_memory;
+  for (auto& w : interpreted_writes) {
+    expected_memory[w.first] = storage->read_doubleword(w.first);
+  }
+
+  // Back to the starting state
+  for (auto w = interpreted_writes.rbegin(); w != interpreted_writes.rend();
+       ++w) {
+    storage->write_doubleword(w->first, w->second, ~0ULL);
+  }
+  registers = start_registers;
+  pc = start_pc;
+  csr = start_csr;
+  priv = start_priv;
+  update_interrupt_pending();
+  update_sv39_satp();
+  instruction_count = start_count;
+  block->generation = block->source->generation;
+
+  // Native code. Its fast-path stores bypass the journal, so the pages it
+  // can reach that way are copied first (and by jit_step as they are added).
+  check_pages.clear();
+  for (unsigned int t = 0; t < jit_tlb_size; t++) {
+    if (frame.tlb[t].tag % 4096 == 0) {
+      check_pages[frame.tlb[t].tag].assign(frame.tlb[t].data,
+                                           frame.tlb[t].data + 512);
+    }
+  }
+  vector<pair<uint64_t, uint64_t>> native_writes;
+  storage->begin_journal();
+  unsigned int done = block->native(&frame);
+  storage->end_journal(native_writes);
+
+  bool match = done == expected_done && registers == expected_registers &&
+               pc == expected_pc && csr == expected_csr &&
+               priv == expected_priv &&
+               instruction_count + done == expected_count;
+  for (auto& w : expected_memory) {
+    match = match && storage->read_doubleword(w.first) == w.second;
   }
+  for (auto& w : native_writes) {
+    auto found = expected_memory.find(w.first);
+    uint64_t value = found != expected_memory.end() ? found->second : w.second;
+    match = match && storage->read_doubleword(w.first) == value;
+  }
+  for (auto& p : check_pages) {
+    for (unsigned int d = 0; d < 512; d++) {
+      uint64_t address = p.first + 8 * d;
+      uint64_t value = storage->read_doubleword(address);
+      if (value != p.second[d]) {
+        auto found = expected_memory.find(address);
+        match = match && found != expected_memory.end() &&
+                found->second == value;
+      }
+    }
+  }
+  if (match) {
+    return done;
+  }
+
+  jit_mismatches++;
+  cout << "JIT mismatch in block at " << setw(16) << setfill('0') << hex
+       << block->start << endl;
+  for (unsigned int k = 0; k < block->entries.size(); k++) {
+    uint64_t address = block->start + 4 * k;
+    cout << "  " << setw(16) << setfill('0') << hex << address << "  "
+         << disassemble(block->entries[k].inst, address) << endl;
+  }
+  for (auto& p : check_pages) {
+    for (unsigned int d = 0; d < 512; d++) {
+      storage->write_doubleword(p.first + 8 * d, p.second[d], ~0ULL);
+    }
+  }
+  for (auto w = native_writes.rbegin(); w != native_writes.rend(); ++w) {
+    storage->write_doubleword(w->first, w->second, ~0ULL);
+  }
+  for (auto& w : expected_memory) {
+    storage->write_doubleword(w.first, w.second, ~0ULL);
+  }
+  registers = expected_registers;
+  pc = expected_pc;
+  csr = expected_csr;
+  priv = expected_priv;
+  update_interrupt_pending();
+  update_sv39_satp();
+  instruction_count = expected_count - expected_done;
+  return expected_done;
+}
+
+bool breakpoint_condition::holds(const vector<uint64_t>& registers) const {
+  switch (relation) {
+    case EQ:  return registers[reg] == value;
+    case NE:  return registers[reg] != value;
+    case LTU: return registers[reg] < value;
+    case LEU: return registers[reg] <= value;
+    case GTU: return registers[reg] > value;
+    case GEU: return registers[reg] >= value;
+    default:  return true;
+  }
+}
+
+// True if there is a breakpoint at pc whose condition holds
+bool processor::breakpoint_reached() {
+  auto found = breakpoints.find(pc);
+  return found != breakpoints.end() && found->second.holds(registers);
+}
+
+// Index of the first entry after the first of block that is on a breakpoint,
+// or the block length if there is none. Looked up once per block for each
+// change to the set of breakpoints.
+unsigned int processor::breakpoint_index(basic_block* block) {
+  if (block->breakpoint_epoch != breakpoint_epoch) {
+    unsigned int index = 1;
+    while (index < block->entries.size() &&
+           breakpoints.count(block->start + 4 * index) == 0) {
+      index++;
+    }
+    block->breakpoint_stop = index;
+    block->breakpoint_epoch = breakpoint_epoch;
+  }
+  return block->breakpoint_stop;
 }
 
-// Clear breakpoint
-void processor::clear_breakpoint() { breakpoint = ULLONG_MAX; }
+// Clear all breakpoints
+void processor::clear_breakpoint() {
+  breakpoints.clear();
+  breakpoint_epoch++;
+}
 
 // Set breakpoint at an address
-void processor::set_breakpoint(uint64_t address) { breakpoint = address; }
+void processor::set_breakpoint(uint64_t address) {
+  breakpoint_condition always;
+  always.relation = breakpoint_condition::ALWAYS;
+  always.reg = 0;
+  always.value = 0;
+  set_breakpoint(address, always);
+}
+
+void processor::set_breakpoint(uint64_t address,
+                               breakpoint_condition condition) {
+  breakpoints[address] = condition;
+  breakpoint_epoch++;
+}
+
+// Watched pages are kept out of the data TLB, so their accesses go through
+// memory
+void processor::set_watchpoint(uint64_t address, bool reads) {
+  storage->add_watchpoint(address, reads ? memory::WATCH_READ | memory::WATCH_WRITE
+                                         : memory::WATCH_WRITE);
+  flush_tlbs();
+}
+
+void processor::clear_watchpoints() { storage->clear_watchpoints(); }
+
+// Remove the breakpoint and watchpoint at an address
+void processor::delete_point(uint64_t address) {
+  if (breakpoints.erase(address) != 0) {
+    breakpoint_epoch++;
+  }
+  storage->remove_watchpoint(address);
+}
+
+// Memory snapshots share pages that the TLBs may hold, so both are emptied
+unsigned int processor::snapshot() {
+  processor_snapshot saved;
+  saved.memory_id = storage->snapshot();
+  saved.registers = registers;
+  saved.pc = pc;
+  saved.csr = csr;
+  saved.priv = priv;
+  snapshots.push_back(saved);
+  flush_tlbs();
+  return snapshots.size() - 1;
+}
+
+bool processor::restore(unsigned int id) {
+  if (id >= snapshots.size()) {
+    return false;
+  }
+  const processor_snapshot& saved = snapshots[id];
+  storage->restore(saved.memory_id);
+  registers = saved.registers;
+  pc = saved.pc;
+  csr = saved.csr;
+  priv = saved.priv;
+  update_interrupt_pending();
+  update_sv39_satp();
+  flush_tlbs();
+  return true;
+}
+
+void processor::set_baseline() { baseline = snapshot(); }
+
+bool processor::reset_to_baseline() {
+  if (baseline < 0) {
+    return false;
+  }
+  auto start = chrono::steady_clock::now();
+  uint64_t restored = storage->get_restored_pages();
+  restore(baseline);
+  reset_pages += storage->get_restored_pages() - restored;
+  resets++;
+  reset_nanoseconds += chrono::duration_cast<chrono::nanoseconds>(
+                           chrono::steady_clock::now() - start).count();
+  return true;
+}
+
+uint64_t processor::get_resets() { return resets; }
+
+uint64_t processor::get_reset_pages() { return reset_pages; }
+
+uint64_t processor::get_reset_nanoseconds() { return reset_nanoseconds; }
 
 // TODO stage2
 // Show privilege level
@@ -1100,6 +1436,7 @@ void processor::set_prv(unsigned int prv_num) {
   } else {
     cout << "ERROR: prv_num is not 0 or 3" << endl;
   }
+  update_interrupt_pending();
   return;
 }
 
@@ -1110,7 +1447,7 @@ void processor::show_csr(unsigned int csr_num) {
       csr_num == 0xf14 || csr_num == 0x300 || csr_num == 0x301 ||
       csr_num == 0x304 || csr_num == 0x305 || csr_num == 0x340 ||
       csr_num == 0x341 || csr_num == 0x342 || csr_num == 0x343 ||
-      csr_num == 0x344) {
+      csr_num == 0x344 || csr_num == 0x180) {
     cout << setw(16) << setfill('0') << hex << csr[csr_num] << endl;
   } else {
     cout << "Illegal CSR number" << endl;
@@ -1156,22 +1493,64 @@ void processor::set_csr(unsigned int csr_num, uint64_t new_value) {
   } else if (csr_num == 0x344) {  // mip
     new_value = new_value & 0x0000000000000999;  // for implemented bits
     csr[csr_num] = new_value;
+  } else if (csr_num == 0x180) {  // satp
+    if ((new_value >> 60) == 0 || (new_value >> 60) == 8) {  // Bare or Sv39
+      csr[csr_num] = new_value;  // other modes leave satp unchanged
+      update_sv39_satp();
+    }
   } else {
     if (is_verbose) {
       cout << "csr not implemented" << endl;
     }
   }
+  if (csr_num == 0x300 || csr_num == 0x304 || csr_num == 0x344) {
+    update_interrupt_pending();
+  }
 
   return;
 }
 
+// Recompute whether an interrupt may be taken: interrupts are enabled
+// (mstatus.MIE, or running in user mode) and some interrupt is both pending
+// in mip and enabled in mie. Must be called whenever mstatus, mie, mip or
+// priv change.
+void processor::update_interrupt_pending() {
+  interrupt_pending = halted || (((csr[0x300] & 0x8) || (priv == 0)) &&
+                                 (csr[0x344] & csr[0x304] & 0x999) != 0);
+}
+
+// A device raises or lowers its line into mip
+void processor::set_interrupt(uint64_t mip_bit, bool raised) {
+  if (raised) {
+    csr[0x344] |= mip_bit;
+  } else {
+    csr[0x344] &= ~mip_bit;
+  }
+  update_interrupt_pending();
+}
+
+// Execution stops at the next block boundary. The interrupt check is where
+// the execute loop notices, so running costs nothing extra.
+void processor::halt() {
+  halted = true;
+  update_interrupt_pending();
+}
+
+bool processor::is_halted() { return halted; }
+
+scheduler* processor::get_scheduler() { return &events; }
+
+uint64_t processor::get_access_count() {
+  return instruction_count + access_offset;
+}
+
 bool processor::illegal_csr(uint64_t csr_num, uint64_t reg1) {
   bool valid_csr = false;
   if (csr_num == 0xf11 || csr_num == 0xf12 || csr_num == 0xf13 ||
       csr_num == 0xf14 || csr_num == 0x300 || csr_num == 0x301 ||
       csr_num == 0x304 || csr_num == 0x305 || csr_num == 0x340 ||
       csr_num == 0x341 || csr_num == 0x342 || csr_num == 0x343 ||
-      csr_num == 0x344) {
+      csr_num == 0x344 || csr_num == 0x180) {
     valid_csr = true;
   }
   if (priv == 0 || valid_csr == false || (csr_num == 0xf11 && reg1 != 0) ||
@@ -1187,7 +1566,7 @@ bool processor::illegal_csr_imm(uint64_t csr_num) {
       csr_num == 0xf14 || csr_num == 0x300 || csr_num == 0x301 ||
       csr_num == 0x304 || csr_num == 0x305 || csr_num == 0x340 ||
       csr_num == 0x341 || csr_num == 0x342 || csr_num == 0x343 ||
-      csr_num == 0x344) {
+      csr_num == 0x344 || csr_num == 0x180) {
     valid_csr = true;
   }
   if (priv == 0 || valid_csr == false) {
@@ -1215,6 +1594,7 @@ void processor::cause_interrupt(int cause) {
     }
 
     priv = 3;              // set priv to machine mode
+    update_interrupt_pending();
   } else if (priv == 3) {  // if priv ==3, set mpp =3
     set_csr(0x300, csr[0x300] | 0x0000000000001800);
   }
@@ -1226,3 +1606,43 @@ uint64_t processor::get_instruction_count() { return instruction_count; }
 
 // Used for Postgraduate assignment. Undergraduate assignment can return 0.
 uint64_t processor::get_cycle_count() { return 0; }
+
+uint64_t processor::get_predecode_hits() { return predecode_hits; }
+
+uint64_t processor::get_predecode_misses() { return predecode_misses; }
+
+uint64_t processor::get_fetch_tlb_hits() { return fetch_tlb_hits; }
+
+uint64_t processor::get_fetch_tlb_misses() { return fetch_tlb_misses; }
+
+uint64_t processor::get_data_tlb_hits() { return data_tlb_hits; }
+
+uint64_t processor::get_data_tlb_misses() { return data_tlb_misses; }
+
+uint64_t processor::get_sv39_tlb_hits() { return mmu->get_tlb_hits(); }
+
+uint64_t processor::get_sv39_tlb_misses() { return mmu->get_tlb_misses(); }
+
+uint64_t processor::get_page_walks() { return mmu->get_walks(); }
+
+uint64_t processor::get_walk_cache_hits() { return mmu->get_walk_cache_hits(); }
+
+uint64_t processor::get_page_faults() { return mmu->get_page_faults(); }
+
+uint64_t processor::get_jit_compiled() { return jit_compiled; }
+
+uint64_t processor::get_jit_mismatches() { return jit_mismatches; }
+
+bool processor::jit_enabled() { return compiler != nullptr; }
+
+bool processor::jit_checking() { return jit_check; }
+
+void processor::disable_fusion() { fusion = false; }
+
+uint64_t processor::get_fused_pairs() { return fused_pairs; }
+
+bool processor::aot_enabled() { return translation != nullptr; }
+
+unsigned int processor::get_aot_blocks() {
+  return translation ? translation->size() : 0;
+}
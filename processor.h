@@ -9,10 +9,48 @@
 
 **************************************************************** */
 
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "aot.h"
+#include "block.h"
+#include "decoder.h"
+#include "jit.h"
 #include "memory.h"
+#include "scheduler.h"
+#include "sv39.h"
 
 using namespace std;
 
+// Condition under which a breakpoint stops execution: x[reg] compared with
+// value (unsigned). A plain breakpoint is ALWAYS.
+struct breakpoint_condition {
+  enum relation_type { ALWAYS, EQ, NE, LTU, LEU, GTU, GEU } relation;
+  unsigned int reg;
+  uint64_t value;
+  bool holds(const vector<uint64_t>& registers) const;
+};
+
+// Entry of the fetch TLB: guest page address to the page, with its
+// predecode table allocated
+struct fetch_tlb_entry {
+  uint64_t tag;  // guest page address, or 1 when empty
+  page* code;
+};
+
+static const unsigned int fetch_tlb_size = 16;
+
+// Architectural state saved with a memory snapshot
+struct processor_snapshot {
+  unsigned int memory_id;
+  vector<uint64_t> registers;
+  uint64_t pc;
+  unordered_map<uint64_t, uint64_t> csr;
+  int priv;
+};
+
 class processor {
 
  private:
@@ -23,31 +61,131 @@ class processor {
 
  vector<uint64_t> registers;
  uint64_t pc;
- uint64_t breakpoint;
  uint64_t instruction_count;
- int current_instruction[32];
- uint32_t curr_inst;
+
+ // Breakpoints by address. Each block caches the index of its first
+ // breakpoint, valid while its breakpoint_epoch matches this one.
+ unordered_map<uint64_t, breakpoint_condition> breakpoints;
+ uint64_t breakpoint_epoch;
+ bool breakpoint_reached();
+ unsigned int breakpoint_index(basic_block* block);
+ bool watch_reached();
+
+ // execute's loop, specialised for the modes it runs in
+ template <bool verbose, bool stopping, bool watching>
+ void run(unsigned int num);
+
+ // Predecode cache statistics
+ uint64_t predecode_hits;
+ uint64_t predecode_misses;
+
+ // Direct-mapped TLBs from guest pages to host pages: one for fetch, and
+ // one for data (frame.tlb, shared with native code)
+ fetch_tlb_entry fetch_tlb[fetch_tlb_size];
+ bool data_tlb_fill;  // false while run_checked must journal every store
+ uint64_t fetch_tlb_hits;
+ uint64_t fetch_tlb_misses;
+ uint64_t data_tlb_hits;
+ uint64_t data_tlb_misses;
+ page* code_page(uint64_t address);
+ template <typename T> bool load_miss(uint64_t address, T& data);
+ template <typename T> bool store_miss(uint64_t address, T data);
+ void fill_data_tlb(uint64_t address, uint64_t physical, bool writable);
+
+ // Sv39 translation of user-mode addresses, when satp selects it. The data
+ // TLB then holds virtual pages; data_tlb_satp is the satp it was filled
+ // under (0 for physical addresses), and it is emptied when that changes.
+ // The fetch TLB and blocks are always by physical address.
+ unique_ptr<sv39> mmu;
+ uint64_t data_tlb_satp;
+ uint64_t sv39_satp;  // satp if it selects Sv39, else 0; kept with csr[0x180]
+ uint64_t translating_satp();
+ void update_sv39_satp();
+ bool translate(uint64_t address, sv39::access_type access,
+                uint64_t& physical, bool& writable);
+
+ // Translated blocks, by start address
+ static const void* const* block_handlers;
+ unordered_map<uint64_t, unique_ptr<basic_block>> blocks;
+ bool fusion;           // run common instruction pairs as one
+ uint64_t fused_pairs;  // pairs fused at translation
+
+ // Native code for blocks run jit_threshold times to completion
+ static const unsigned int jit_threshold = 50;
+ unique_ptr<jit> compiler;  // null unless -jit
+ jit_frame frame;
+ bool jit_check;            // compare every native run with the interpreter
+ unordered_map<uint64_t, vector<uint64_t>> check_pages;  // copies for the check
+ uint64_t jit_compiled;
+ uint64_t jit_mismatches;
+
+ // Ahead-of-time translation of the loaded image, if -aot
+ unique_ptr<aot> translation;
   // TODO: Add private members here *stage 2*
  unordered_map<uint64_t,uint64_t> csr;
  int priv;
+ bool interrupt_pending;  // an interrupt may be taken; see update_interrupt_pending
+ bool halted;             // stopped for good by a device
+
+ // Device events by instruction count. A block is cut short so that it
+ // ends at the next event, which fires before the following block.
+ // access_offset is the number of instructions of the current block run
+ // before the load or store missing the data TLB, so a device sees the
+ // exact count; step_offset is those run natively before jit_step.
+ scheduler events;
+ unsigned int access_offset;
+ unsigned int step_offset;
+
+ vector<processor_snapshot> snapshots;
+
+ // Snapshot reset_to_baseline returns to (-1 if none), and the cost of resets
+ int baseline;
+ uint64_t resets;
+ uint64_t reset_pages;
+ uint64_t reset_nanoseconds;
 
  public:
 
   // Consructor
   processor(memory* main_memory, bool verbose, bool stage2);
 
-  //load instruction in memory to array
-  void load_instruction(uint64_t value, uint64_t pc);
+  //decode the instruction at address in page p through the predecode cache
+  const decoded_instruction& predecode(page* p, uint64_t address);
+
+  //fetch the decoded instruction at a physical address (pc, translated)
+  //through the predecode cache
+  const decoded_instruction& fetch(uint64_t address);
+
+  //empty the fetch and data TLBs, after pages are remapped or freed
+  void flush_tlbs();
+
+  //find or translate the block starting at address
+  basic_block* lookup_block(uint64_t address);
+  void translate_block(basic_block* block);
+  void revalidate_block(basic_block* block);
+  void fuse_pairs(basic_block* block);
+  void disable_fusion();
+
+  //run entries of a translated block, returning the number executed
+  unsigned int run_block(const block_entry* e, unsigned int count,
+                         const page* source, uint64_t generation);
 
-  //find what type of instruction
-  string instruction_type();
+  //compile hot blocks to native code, optionally checking every run
+  void enable_jit(bool self_check);
+  void compile_block(basic_block* block);
+  static unsigned int jit_step(void* cpu, const basic_block* block,
+                               unsigned int index);
+  unsigned int run_checked(basic_block* block);
 
-  //return signed decimal value
-  uint64_t binary_return(int start, int length, bool is_signed);
+  //translate loaded images ahead of time, caching them in directory
+  void enable_aot(string directory);
+  void translate_image();
 
+  //print the verbose trace of a decoded instruction
+  void trace_instruction(const decoded_instruction& inst);
 
-  //do instruction
-  void do_instruction( string type);
+  //do a Zicsr or privileged instruction
+  void do_system_instruction(const decoded_instruction& inst);
 
   // Display PC value
   void show_pc();
@@ -64,12 +202,38 @@ class processor {
   // Execute a number of instructions
   void execute(unsigned int num, bool breakpoint_check);
 
-  // Clear breakpoint
+  // Clear all breakpoints
   void clear_breakpoint();
 
-  // Set breakpoint at an address
+  // Set breakpoint at an address, optionally only stopping if condition holds
   void set_breakpoint(uint64_t address);
-  
+  void set_breakpoint(uint64_t address, breakpoint_condition condition);
+
+  // Watch the doubleword holding an address for writes, and optionally reads
+  void set_watchpoint(uint64_t address, bool reads);
+
+  // Clear all watchpoints
+  void clear_watchpoints();
+
+  // Remove the breakpoint and watchpoint at an address
+  void delete_point(uint64_t address);
+
+  // Save the processor and memory state, returning an id for restore
+  unsigned int snapshot();
+
+  // Return to a saved state, returning false if there is no such id
+  bool restore(unsigned int id);
+
+  // Save the current state as the baseline, and return to it, copying back
+  // only the pages written since. reset_to_baseline returns false if there
+  // is no baseline.
+  void set_baseline();
+  bool reset_to_baseline();
+
+  // Reset statistics
+  uint64_t get_resets();
+  uint64_t get_reset_pages();
+  uint64_t get_reset_nanoseconds();
 
   // Show privilege level
   // Empty implementation for stage 1, required for stage 2
@@ -87,14 +251,59 @@ class processor {
   // Empty implementation for stage 1, required for stage 2
   void set_csr(unsigned int csr_num, uint64_t new_value);
 
-  void raise_exception(int cause);
+  // tval is the faulting address for misaligned loads and stores, and for
+  // load and store page faults
+  void raise_exception(int cause, uint64_t tval = 0);
   void cause_interrupt(int cause);
 
+  // Recompute interrupt_pending after a change to mstatus, mie, mip or priv
+  // (including a device raising or lowering an interrupt line)
+  void update_interrupt_pending();
+
+  // For devices: raise or lower an interrupt line (a bit of mip), and stop
+  // execution for good (a test finisher)
+  void set_interrupt(uint64_t mip_bit, bool raised);
+  void halt();
+  bool is_halted();
+
+  // For devices: the event scheduler, and the instruction count at the
+  // access being made (mtime)
+  scheduler* get_scheduler();
+  uint64_t get_access_count();
+
   uint64_t get_instruction_count();
 
   // Used for Postgraduate assignment. Undergraduate assignment can return 0.
   uint64_t get_cycle_count();
 
+  // Predecode cache statistics
+  uint64_t get_predecode_hits();
+  uint64_t get_predecode_misses();
+
+  // TLB statistics
+  uint64_t get_fetch_tlb_hits();
+  uint64_t get_fetch_tlb_misses();
+  uint64_t get_data_tlb_hits();
+  uint64_t get_data_tlb_misses();
+
+  // Sv39 statistics
+  uint64_t get_sv39_tlb_hits();
+  uint64_t get_sv39_tlb_misses();
+  uint64_t get_page_walks();
+  uint64_t get_walk_cache_hits();
+  uint64_t get_page_faults();
+
+  // Macro-op fusion statistics
+  uint64_t get_fused_pairs();
+
+  // JIT statistics
+  bool jit_enabled();
+  bool jit_checking();
+  uint64_t get_jit_compiled();
+  uint64_t get_jit_mismatches();
+  bool aot_enabled();
+  unsigned int get_aot_blocks();
+
   bool illegal_csr(uint64_t csr_num, uint64_t reg1);
   bool illegal_csr_imm(uint64_t csr_num);
 
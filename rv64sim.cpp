@@ -8,15 +8,48 @@
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <string>
+#include <vector>
 #include <stdlib.h> 
+#include <unistd.h>
 
 #include "memory.h"
 #include "processor.h"
 #include "commands.h"
+#include "clint.h"
+#include "plic.h"
+#include "test_finisher.h"
+#include "uart.h"
 
 using namespace std;
 
+// Hits as a percentage of all lookups
+string hit_rate(uint64_t hits, uint64_t misses) {
+  ostringstream rate;
+  rate << fixed << setprecision(2)
+       << (hits + misses == 0 ? 0.0 : 100.0 * hits / (hits + misses)) << "%";
+  return rate.str();
+}
+
+// Parse a RAM region "BASE:SIZE[:huge]": BASE in hex, SIZE a number
+// (0x for hex) optionally followed by K, M or G
+bool parse_ram_region(string spec, uint64_t& base, uint64_t& size, bool& huge) {
+  char* end;
+  base = strtoull(spec.c_str(), &end, 16);
+  if (end == spec.c_str() || *end != ':') return false;
+  const char* size_start = end + 1;
+  size = strtoull(size_start, &end, 0);
+  if (end == size_start) return false;
+  switch (*end) {
+    case 'K': size <<= 10; end++; break;
+    case 'M': size <<= 20; end++; break;
+    case 'G': size <<= 30; end++; break;
+  }
+  huge = string(end) == ":huge";
+  return *end == 0 || huge;
+}
+
 int main(int argc, char* argv[]) {
 
     // Values of command line options. 
@@ -24,6 +57,14 @@ int main(int argc, char* argv[]) {
     bool verbose = false;
     bool cycle_reporting = false;
     bool stage2 = false;
+    bool use_jit = false;
+    bool jit_check = false;
+    bool use_aot = false;
+    bool fusion = true;
+    bool devices = false;
+    bool use_image_cache = true;
+    int load_threads = 0;  // one per hardware thread
+    vector<string> ram_regions;
 
     memory* main_memory;
     processor* cpu;
@@ -39,15 +80,80 @@ int main(int argc, char* argv[]) {
 	    cycle_reporting = true;
 	else if (arg == "-s2")  // Stage 2 functionality enabled
 	    stage2 = true;
+	else if (arg == "-jit")  // Compile hot blocks to native code
+	    use_jit = true;
+	else if (arg == "-nofuse")  // Run every instruction on its own
+	    fusion = false;
+	else if (arg == "-aot")  // Translate loaded images to shared objects
+	    use_aot = true;
+	else if (arg == "-jitcheck") {  // ... and check them against the interpreter
+	    use_jit = true;
+	    jit_check = true;
+	}
+	else if (arg == "-ram" && i + 1 < argc)  // Flat RAM region BASE:SIZE[:huge]
+	    ram_regions.push_back(argv[++i]);
+	else if (arg == "-devices")  // UART, CLINT, PLIC and test finisher
+	    devices = true;
+	else if (arg == "-loadthreads" && i + 1 < argc)  // Threads decoding large hex files
+	    load_threads = atoi(argv[++i]);
+	else if (arg == "-nocache")  // Neither use nor write hex image caches
+	    use_image_cache = false;
 	else {
 	    cout << argv[0] << ": Unknown option: " << arg << endl;
 	}
     }
 
     main_memory = new memory (verbose);
+    if (load_threads > 0)
+	main_memory->set_load_threads(load_threads);
+    main_memory->set_image_cache(use_image_cache);
+    for (string& spec : ram_regions) {
+	uint64_t base, size;
+	bool huge;
+	if (!parse_ram_region(spec, base, size, huge))
+	    cout << argv[0] << ": Bad RAM region: " << spec << endl;
+	else if (!main_memory->add_region(base, size, huge))
+	    cout << argv[0] << ": Cannot map RAM region " << spec
+		 << ", using sparse store" << endl;
+    }
     cpu = new processor (main_memory, verbose, stage2);
+    if (!fusion)
+	cpu->disable_fusion();
+    if (use_jit)
+	cpu->enable_jit(jit_check);
+    if (use_aot) {
+	// Translations are cached across runs, in $RV64SIM_AOT_CACHE or the
+	// user's own cache directory. A directory shared with other users is
+	// refused, since its shared objects would be loaded and run.
+	const char* cache = getenv("RV64SIM_AOT_CACHE");
+	const char* xdg = getenv("XDG_CACHE_HOME");
+	const char* home = getenv("HOME");
+	string directory;
+	if (cache && *cache)
+	    directory = cache;
+	else if (xdg && *xdg)
+	    directory = string(xdg) + "/rv64sim-aot";
+	else if (home && *home)
+	    directory = string(home) + "/.cache/rv64sim-aot";
+	else
+	    directory = "/tmp/rv64sim-aot-" + to_string(getuid());
+	cpu->enable_aot(directory);
+    }
+
+    // Devices at the addresses of the QEMU virt machine
+    test_finisher* finisher = nullptr;
+    if (devices) {
+	plic* interrupt_controller = new plic (cpu);
+	finisher = new test_finisher (cpu);
+	main_memory->attach_device(0x00100000, 0x1000, finisher);
+	main_memory->attach_device(0x02000000, 0x10000, new clint (cpu));
+	main_memory->attach_device(0x0c000000, 0x201000, interrupt_controller);
+	main_memory->attach_device(0x10000000, 0x1000, new uart (interrupt_controller, 10));
+    }
 
     interpret_commands(main_memory, cpu, verbose);
+    if (cpu->is_halted())
+	cout << "Test finished, status " << dec << finisher->exit_status() << endl;
 
     // Report final statistics
 
@@ -61,5 +167,42 @@ int main(int argc, char* argv[]) {
 	cpu_cycle_count = cpu->get_cycle_count();
 
 	cout << "CPU cycle count: " << dec << cpu_cycle_count << endl;
+
+	cout << "Predecode cache hits: " << dec << cpu->get_predecode_hits() << endl;
+	cout << "Predecode cache misses: " << dec << cpu->get_predecode_misses() << endl;
+
+	cout << "Fetch TLB hits: " << dec << cpu->get_fetch_tlb_hits()
+	     << " (" << hit_rate(cpu->get_fetch_tlb_hits(), cpu->get_fetch_tlb_misses()) << ")" << endl;
+	cout << "Fetch TLB misses: " << dec << cpu->get_fetch_tlb_misses() << endl;
+	cout << "Data TLB hits: " << dec << cpu->get_data_tlb_hits()
+	     << " (" << hit_rate(cpu->get_data_tlb_hits(), cpu->get_data_tlb_misses()) << ")" << endl;
+	cout << "Data TLB misses: " << dec << cpu->get_data_tlb_misses() << endl;
+	cout << "Sv39 TLB hits: " << dec << cpu->get_sv39_tlb_hits()
+	     << " (" << hit_rate(cpu->get_sv39_tlb_hits(), cpu->get_sv39_tlb_misses()) << ")" << endl;
+	cout << "Sv39 TLB misses: " << dec << cpu->get_sv39_tlb_misses() << endl;
+	cout << "Page table walks: " << dec << cpu->get_page_walks()
+	     << " (" << dec << cpu->get_walk_cache_hits() << " from the walk cache)" << endl;
+	cout << "Page faults: " << dec << cpu->get_page_faults() << endl;
+
+	cout << "Pages allocated: " << dec << main_memory->get_allocated_pages() << endl;
+	cout << "Pages read but not allocated: " << dec << main_memory->get_read_only_pages() << endl;
+
+	if (cpu->get_resets() != 0) {
+	    cout << "Resets to baseline: " << dec << cpu->get_resets() << endl;
+	    cout << "Reset pages copied: " << dec << cpu->get_reset_pages() << endl;
+	    cout << "Reset time: " << fixed << setprecision(2)
+		 << cpu->get_reset_nanoseconds() / 1000.0 / cpu->get_resets() << " us average" << endl;
+	}
+
+	cout << "Fused instruction pairs: " << dec << cpu->get_fused_pairs() << endl;
+	if (cpu->aot_enabled())
+	    cout << "AOT blocks translated: " << dec << cpu->get_aot_blocks() << endl;
+	if (cpu->jit_enabled()) {
+	    cout << "JIT blocks compiled: " << dec << cpu->get_jit_compiled() << endl;
+	    if (cpu->jit_checking())
+		cout << "JIT mismatches: " << dec << cpu->get_jit_mismatches() << endl;
+	}
     }
+
+    return finisher != nullptr ? finisher->exit_status() : 0;
 }
@@ -0,0 +1,49 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Class members for scheduler
+
+**************************************************************** */
+
+#include "scheduler.h"
+
+#include <climits>
+
+using namespace std;
+
+// Constructor
+scheduler::scheduler() {
+  next = UINT64_MAX;
+  fired = 0;
+}
+
+void scheduler::schedule(timed_event* event, uint64_t time) {
+  cancel(event);
+  queue.insert(make_pair(time, event));
+  scheduled[event] = time;
+  next = queue.begin()->first;
+}
+
+void scheduler::cancel(timed_event* event) {
+  auto found = scheduled.find(event);
+  if (found == scheduled.end()) {
+    return;
+  }
+  queue.erase(make_pair(found->second, event));
+  scheduled.erase(found);
+  next = queue.empty() ? UINT64_MAX : queue.begin()->first;
+}
+
+// An event is taken off before it fires, so that it may schedule itself
+// again
+void scheduler::run(uint64_t now) {
+  while (next <= now) {
+    timed_event* event = queue.begin()->second;
+    cancel(event);
+    fired++;
+    event->fire(now);
+  }
+}
+
+uint64_t scheduler::get_fired() { return fired; }
@@ -0,0 +1,66 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Discrete-event scheduler, keyed on instruction count
+
+**************************************************************** */
+
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+using namespace std;
+
+// Something that happens once a given number of instructions have been
+// executed, such as a timer reaching its deadline
+class timed_event {
+
+ public:
+
+  virtual ~timed_event() {}
+
+  // Called when the instruction count reaches the time the event was
+  // scheduled for
+  virtual void fire(uint64_t now) = 0;
+
+};
+
+// Events in time order. The time of the first is kept in next, so the
+// execute loop compares the instruction count with one value rather than
+// asking each device.
+class scheduler {
+
+ private:
+  set<pair<uint64_t, timed_event*>> queue;
+  unordered_map<timed_event*, uint64_t> scheduled;  // time of each event
+  uint64_t next;
+  uint64_t fired;
+
+ public:
+
+  // Constructor
+  scheduler();
+
+  // Time of the first event, or UINT64_MAX if there is none
+  uint64_t next_time() { return next; }
+
+  // Schedule an event at time, in place of any earlier schedule of it
+  void schedule(timed_event* event, uint64_t time);
+
+  // Take an event off the schedule, if it is on it
+  void cancel(timed_event* event);
+
+  // Fire the events due by now, in time order
+  void run(uint64_t now);
+
+  // Number of events fired
+  uint64_t get_fired();
+
+};
+
+#endif
@@ -0,0 +1,179 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Class members for sv39
+
+**************************************************************** */
+
+#include "sv39.h"
+
+using namespace std;
+
+static const uint64_t ppn_mask = (1ULL << 44) - 1;
+static const uint64_t vpn_mask = (1ULL << 27) - 1;
+
+// Constructor
+sv39::sv39(memory* main_memory) {
+  storage = main_memory;
+  tlb_hits = 0;
+  tlb_misses = 0;
+  walks = 0;
+  walk_cache_hits = 0;
+  page_faults = 0;
+  fence(0, false, 0, false);
+}
+
+bool sv39::permits(uint64_t flags, access_type access) {
+  if (!(flags & PTE_U)) {
+    return false;  // only user mode is translated
+  }
+  switch (access) {
+    case ACCESS_FETCH:
+      return flags & PTE_X;
+    case ACCESS_LOAD:
+      return flags & PTE_R;
+    default:
+      return flags & PTE_W;
+  }
+}
+
+// Translate through the TLB. An entry for the page is used unless this is
+// the first store to it, which must walk the table again to set D.
+bool sv39::translate(uint64_t satp, uint64_t address, access_type access,
+                     uint64_t& physical, bool& writable) {
+  if ((uint64_t)((int64_t)(address << 25) >> 25) != address) {
+    page_faults++;  // bits 63-39 must all equal bit 38
+    return false;
+  }
+  uint64_t vpn = (address >> 12) & vpn_mask;
+  uint16_t asid = (satp >> 44) & 0xffff;
+  const sv39_tlb_entry* found = nullptr;
+  for (sv39_tlb_entry& e : tlb[vpn % tlb_sets]) {
+    if (e.valid && e.vpn == vpn && (e.asid == asid || (e.flags & PTE_G))) {
+      found = &e;
+      break;
+    }
+  }
+  if (found != nullptr &&
+      (access != ACCESS_STORE || (found->flags & PTE_D) ||
+       !permits(found->flags, access))) {
+    tlb_hits++;
+  } else {
+    tlb_misses++;
+    found = walk(satp, address, access);
+  }
+  if (found == nullptr || !permits(found->flags, access)) {
+    page_faults++;
+    return false;
+  }
+  physical = found->ppn << 12 | address % 4096;
+  writable = permits(found->flags, ACCESS_LOAD) &&
+             permits(found->flags, ACCESS_STORE) && (found->flags & PTE_D);
+  return true;
+}
+
+// The walk starts from the last-level table if the walk cache has it, so a
+// TLB miss on a 4Kbyte page usually costs one PTE read rather than three.
+const sv39_tlb_entry* sv39::walk(uint64_t satp, uint64_t address,
+                                 access_type access) {
+  walks++;
+  uint64_t root = (satp & ppn_mask) << 12;
+  uint64_t table = root;
+  int level = 2;
+  sv39_walk_entry& cached = walk_cache[(address >> 21) % walk_cache_size];
+  if (cached.valid && cached.root == root && cached.vpn21 == address >> 21) {
+    walk_cache_hits++;
+    table = cached.table;
+    level = 0;
+  }
+
+  uint64_t pte_address;
+  uint64_t pte;
+  for (;;) {
+    pte_address = table + 8 * ((address >> (12 + 9 * level)) & 0x1ff);
+    pte = storage->read<uint64_t>(pte_address);
+    if (!(pte & PTE_V) || (!(pte & PTE_R) && (pte & PTE_W)) ||
+        (pte >> 54) != 0) {
+      return nullptr;  // invalid, or reserved bits set
+    }
+    if (pte & (PTE_R | PTE_X)) {
+      break;  // leaf
+    }
+    if (level == 0) {
+      return nullptr;
+    }
+    level--;
+    table = ((pte >> 10) & ppn_mask) << 12;
+    if (level == 0) {
+      cached.root = root;
+      cached.vpn21 = address >> 21;
+      cached.table = table;
+      cached.valid = true;
+    }
+  }
+  uint64_t ppn = (pte >> 10) & ppn_mask;
+  uint64_t low_vpn_bits = (1ULL << (9 * level)) - 1;
+  if ((ppn & low_vpn_bits) != 0 || !permits(pte, access)) {
+    return nullptr;  // misaligned superpage, or access not allowed
+  }
+  uint64_t updated = pte | PTE_A | (access == ACCESS_STORE ? PTE_D : 0);
+  if (updated != pte) {
+    storage->write<uint64_t>(pte_address, updated);
+    pte = updated;
+  }
+
+  // Enter the 4Kbyte page, replacing any stale entry for it
+  uint64_t vpn = (address >> 12) & vpn_mask;
+  uint16_t asid = (satp >> 44) & 0xffff;
+  sv39_tlb_entry* set = tlb[vpn % tlb_sets];
+  sv39_tlb_entry* e = nullptr;
+  for (unsigned int w = 0; w < tlb_ways; w++) {
+    if (set[w].valid && set[w].vpn == vpn &&
+        (set[w].asid == asid || (set[w].flags & PTE_G))) {
+      e = &set[w];
+    }
+  }
+  if (e == nullptr) {
+    e = &set[victim[vpn % tlb_sets]];
+    victim[vpn % tlb_sets] = (victim[vpn % tlb_sets] + 1) % tlb_ways;
+  }
+  e->vpn = vpn;
+  e->ppn = ppn | (vpn & low_vpn_bits);
+  e->asid = asid;
+  e->flags = pte & 0xff;
+  e->valid = true;
+  e->super = level > 0;
+  return e;
+}
+
+// Superpage entries cover more than their own vpn, so an address fence
+// drops them all. The walk cache holds no leaves; it is always emptied.
+void sv39::fence(uint64_t address, bool one_address, uint16_t asid,
+                 bool one_asid) {
+  uint64_t vpn = (address >> 12) & vpn_mask;
+  for (unsigned int s = 0; s < tlb_sets; s++) {
+    for (sv39_tlb_entry& e : tlb[s]) {
+      if ((!one_address || e.vpn == vpn || e.super) &&
+          (!one_asid || (e.asid == asid && !(e.flags & PTE_G)))) {
+        e.valid = false;
+      }
+    }
+    if (!one_address && !one_asid) {
+      victim[s] = 0;
+    }
+  }
+  for (sv39_walk_entry& w : walk_cache) {
+    w.valid = false;
+  }
+}
+
+uint64_t sv39::get_tlb_hits() { return tlb_hits; }
+
+uint64_t sv39::get_tlb_misses() { return tlb_misses; }
+
+uint64_t sv39::get_walks() { return walks; }
+
+uint64_t sv39::get_walk_cache_hits() { return walk_cache_hits; }
+
+uint64_t sv39::get_page_faults() { return page_faults; }
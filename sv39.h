@@ -0,0 +1,102 @@
+#ifndef SV39_H
+#define SV39_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Sv39 address translation, with a TLB and a page-table-walk cache
+
+**************************************************************** */
+
+#include <cstdint>
+
+#include "memory.h"
+
+using namespace std;
+
+// A translation cached in the TLB: one 4Kbyte virtual page (a piece of a
+// megapage or gigapage if the leaf was higher up), tagged with its ASID
+struct sv39_tlb_entry {
+  uint64_t vpn;    // virtual page number
+  uint64_t ppn;    // physical page number of the 4Kbyte page
+  uint16_t asid;
+  uint8_t flags;   // PTE bits 0-7: V R W X U G A D
+  bool valid;
+  bool super;      // from a megapage or gigapage leaf
+};
+
+// A non-leaf PTE cached by the walk cache: the physical address of the
+// last-level table for a 2Mbyte range, under one root table
+struct sv39_walk_entry {
+  uint64_t root;   // physical address of the root table
+  uint64_t vpn21;  // virtual address >> 21
+  uint64_t table;
+  bool valid;
+};
+
+class sv39 {
+
+ public:
+  enum access_type { ACCESS_FETCH, ACCESS_LOAD, ACCESS_STORE };
+
+  // PTE bits
+  static const uint64_t PTE_V = 0x01;
+  static const uint64_t PTE_R = 0x02;
+  static const uint64_t PTE_W = 0x04;
+  static const uint64_t PTE_X = 0x08;
+  static const uint64_t PTE_U = 0x10;
+  static const uint64_t PTE_G = 0x20;
+  static const uint64_t PTE_A = 0x40;
+  static const uint64_t PTE_D = 0x80;
+
+ private:
+  static const unsigned int tlb_sets = 64;
+  static const unsigned int tlb_ways = 4;
+  static const unsigned int walk_cache_size = 16;
+
+  memory* storage;
+  sv39_tlb_entry tlb[tlb_sets][tlb_ways];
+  unsigned int victim[tlb_sets];  // next way replaced, round robin
+  sv39_walk_entry walk_cache[walk_cache_size];
+
+  uint64_t tlb_hits;
+  uint64_t tlb_misses;
+  uint64_t walks;
+  uint64_t walk_cache_hits;
+  uint64_t page_faults;
+
+  // True if a leaf with these flags allows the access from user mode
+  static bool permits(uint64_t flags, access_type access);
+
+  // Walk the page table from satp for address, setting A (and D for a
+  // store) in the leaf, and enter the result in the TLB. Returns nullptr
+  // on a page fault.
+  const sv39_tlb_entry* walk(uint64_t satp, uint64_t address,
+                             access_type access);
+
+ public:
+
+  // Constructor
+  sv39(memory* main_memory);
+
+  // Translate a user-mode access to address under satp (MODE 8). Returns
+  // false on a page fault. writable is set if the page may also be stored
+  // to without the PTE changing, so that it may be cached for stores too.
+  bool translate(uint64_t satp, uint64_t address, access_type access,
+                 uint64_t& physical, bool& writable);
+
+  // SFENCE.VMA: forget translations for address (all if !one_address) in
+  // asid (all if !one_asid). Global mappings are kept for an asid flush.
+  void fence(uint64_t address, bool one_address, uint16_t asid, bool one_asid);
+
+  // Statistics
+  uint64_t get_tlb_hits();
+  uint64_t get_tlb_misses();
+  uint64_t get_walks();
+  uint64_t get_walk_cache_hits();
+  uint64_t get_page_faults();
+
+};
+
+#endif
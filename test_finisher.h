@@ -0,0 +1,40 @@
+#ifndef TEST_FINISHER_H
+#define TEST_FINISHER_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Test finisher: a device for guest programs to end the simulation
+
+**************************************************************** */
+
+#include <cstdint>
+
+#include "device.h"
+#include "processor.h"
+
+using namespace std;
+
+// Writing 0x5555 to offset 0 ends the run with exit status 0 (pass), and
+// (code << 16) | 0x3333 ends it with status code (fail)
+class test_finisher : public device {
+
+ private:
+  processor* cpu;
+  int status;
+
+ public:
+
+  // Constructor
+  test_finisher(processor* hart);
+
+  uint64_t read(uint64_t offset, unsigned int size);
+  void write(uint64_t offset, uint64_t data, unsigned int size);
+
+  // Exit status asked for, or 0 if the run was not ended by the guest
+  int exit_status();
+
+};
+
+#endif
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Check the CLINT timer interrupt boundary.
+#
+# timer.hex sets mtimecmp to 100 with a store, then counts in a loop;
+# its trap handler at 0x100 spins. mtime counts instructions, so MTIP must
+# still be clear after 100 instructions, and the interrupt must be taken
+# (mcause 7, mepc the next loop instruction) before instruction 101 runs.
+# The same must hold with fusion off and with the JIT.
+#
+# Run from the top of the tree after make:  tests/check_clint_timer.sh
+
+set -e
+tests=$(cd "$(dirname "$0")" && pwd)
+top=$(dirname "$tests")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cp "$tests/timer.hex" "$work"
+
+# mtvec, mie.MTIE and mstatus.MIE, then pc and mip at the deadline and
+# pc, mcause, mip and mepc one instruction later
+cat >"$work/commands" <<COMMANDS
+l "$work/timer.hex"
+csr 305 = 100
+csr 304 = 80
+csr 300 = 8
+. 100
+pc
+csr 344
+. 1
+pc
+csr 342
+csr 344
+csr 341
+COMMANDS
+cat >"$work/expected" <<EXPECTED
+24 bytes loaded, start address = 0000000000000000
+0000000000000010
+0000000000000000
+0000000000000100
+8000000000000007
+0000000000000080
+0000000000000010
+EXPECTED
+
+for options in "" -nofuse -jit; do
+    "$top/rv64sim" -s2 -devices $options <"$work/commands" |
+        grep -v "^Instructions executed" >"$work/actual"
+    if ! diff "$work/expected" "$work/actual"; then
+        echo "timer.hex ${options:-(default)}: FAILED"
+        exit 1
+    fi
+    echo "timer.hex ${options:-(default)}: interrupt taken at mtimecmp"
+done
@@ -0,0 +1,74 @@
+#!/bin/sh
+# Check loading an ELF64 executable.
+#
+# segments.elf has two PT_LOAD segments: 3 pages of code and rodata at
+# 0x80000000, file offset 0x1000, and 0x20 bytes of data at 0x80003010
+# followed by bss up to 0x80005000. Its symbol table names _start and
+# value. The code adds the data doubleword, the rodata doubleword at
+# 0x80002ff8 and two bss doublewords into x5, then spins.
+#
+# Checks the load message, entry point, segment contents, that the code
+# pages are mapped from the file, that stale data under the bss is
+# cleared, that a guest store does not reach the file, the result of
+# running the code, and that a truncated file is refused.
+#
+# Run from the top of the tree after make:  tests/check_elf_load.sh
+
+set -e
+tests=$(cd "$(dirname "$0")" && pwd)
+top=$(dirname "$tests")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cp "$tests/segments.elf" "$work"
+
+cat >"$work/commands" <<COMMANDS
+m 80003100 = 5555555555555555
+m 80004008 = 7777777777777777
+l "$work/segments.elf"
+pc
+m 80000000
+m 80002ff8
+m 80003010
+m 80003100
+m 80004008
+. 11
+x5
+m 80000000 = 0
+m 80000000
+COMMANDS
+cat >"$work/expected" <<EXPECTED
+12320 bytes loaded, start address = 0000000080000000
+0000000080000000
+0100b10300003097
+0123456700000000
+0000000089abcdef
+0000000000000000
+0000000000000000
+0123456789abcdef
+0000000000000000
+Instructions executed: 11
+EXPECTED
+"$top/rv64sim" <"$work/commands" >"$work/actual"
+if ! diff "$work/expected" "$work/actual" ||
+   ! cmp -s "$tests/segments.elf" "$work/segments.elf"; then
+    echo "segments.elf: FAILED"
+    exit 1
+fi
+echo "segments.elf: loaded"
+
+echo "l \"$work/segments.elf\"" | "$top/rv64sim" -v >"$work/verbose"
+if ! grep -q "Mapped 3 pages from the file, 2 symbols" "$work/verbose"; then
+    cat "$work/verbose"
+    echo "segments.elf mapping: FAILED"
+    exit 1
+fi
+echo "segments.elf: 3 pages mapped, 2 symbols"
+
+head -c 100 "$tests/segments.elf" >"$work/truncated.elf"
+echo "l \"$work/truncated.elf\"" | "$top/rv64sim" >"$work/truncated"
+if ! grep -q "Not a RISC-V ELF64 file" "$work/truncated"; then
+    cat "$work/truncated"
+    echo "truncated.elf: FAILED"
+    exit 1
+fi
+echo "truncated.elf: refused"
@@ -0,0 +1,106 @@
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Class members for uart
+
+**************************************************************** */
+
+#include "uart.h"
+
+#include <iostream>
+
+using namespace std;
+
+// Registers, by offset
+static const uint64_t UART_RBR_THR = 0;  // receive / transmit holding
+static const uint64_t UART_IER = 1;
+static const uint64_t UART_IIR_FCR = 2;
+static const uint64_t UART_LCR = 3;
+static const uint64_t UART_LSR = 5;
+static const uint64_t UART_SCR = 7;
+
+static const uint8_t LCR_DLAB = 0x80;
+static const uint8_t IER_THRE = 0x02;
+static const uint8_t LSR_THRE_TEMT = 0x60;  // transmitter empty and idle
+
+// Constructor
+uart::uart(plic* interrupt_controller, unsigned int interrupt_source) {
+  ier = 0;
+  lcr = 0;
+  scr = 0;
+  divisor[0] = 0;
+  divisor[1] = 0;
+  interrupts = interrupt_controller;
+  source = interrupt_source;
+  output.reserve(buffer_size);
+}
+
+uart::~uart() { flush(); }
+
+// Only the byte at offset is accessed, whatever the size
+uint64_t uart::read(uint64_t offset, unsigned int size) {
+  switch (offset) {
+    case UART_RBR_THR:
+      return lcr & LCR_DLAB ? divisor[0] : 0;  // nothing received
+    case UART_IER:
+      return lcr & LCR_DLAB ? divisor[1] : ier;
+    case UART_IIR_FCR:
+      return ier & IER_THRE ? 0x02 : 0x01;  // transmitter empty, or none
+    case UART_LCR:
+      return lcr;
+    case UART_LSR:
+      return LSR_THRE_TEMT;
+    case UART_SCR:
+      return scr;
+    default:
+      return 0;
+  }
+}
+
+void uart::write(uint64_t offset, uint64_t data, unsigned int size) {
+  switch (offset) {
+    case UART_RBR_THR:
+      if (lcr & LCR_DLAB) {
+        divisor[0] = data;
+      } else {
+        output.push_back(data);
+        if (output.size() == buffer_size) {
+          flush();
+        }
+      }
+      break;
+    case UART_IER:
+      if (lcr & LCR_DLAB) {
+        divisor[1] = data;
+      } else {
+        ier = data & 0x0f;
+        update_interrupt();
+      }
+      break;
+    case UART_LCR:
+      lcr = data;
+      break;
+    case UART_SCR:
+      scr = data;
+      break;
+    default:
+      break;  // FIFO control, modem control and status are ignored
+  }
+}
+
+// The transmitter is always empty, so its interrupt is pending whenever it
+// is enabled
+void uart::update_interrupt() {
+  if (interrupts != nullptr) {
+    interrupts->set_source(source, ier & IER_THRE);
+  }
+}
+
+void uart::flush() {
+  if (!output.empty()) {
+    cout.write(output.data(), output.size());
+    cout.flush();
+    output.clear();
+  }
+}
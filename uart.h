@@ -0,0 +1,51 @@
+#ifndef UART_H
+#define UART_H
+
+/* ****************************************************************
+   RISC-V Instruction Set Simulator
+   Computer Architecture, Semester 1, 2024
+
+   Console UART, a subset of the 16550
+
+**************************************************************** */
+
+#include <cstdint>
+#include <string>
+
+#include "device.h"
+#include "plic.h"
+
+using namespace std;
+
+// Transmit only: the transmitter is always ready, and nothing is ever
+// received. Characters written go to a buffer that is written to stdout
+// in one piece when it fills, and whenever execution stops.
+class uart : public device {
+
+ private:
+  static const unsigned int buffer_size = 65536;
+
+  string output;
+  uint8_t ier;  // interrupt enable
+  uint8_t lcr;  // line control; bit 7 selects the divisor latch
+  uint8_t scr;  // scratch
+  uint8_t divisor[2];
+
+  plic* interrupts;  // null if not wired to an interrupt controller
+  unsigned int source;
+  void update_interrupt();
+
+ public:
+
+  // Constructor. The interrupt (transmitter empty, if enabled) goes to
+  // source of interrupt_controller, if given.
+  uart(plic* interrupt_controller = nullptr, unsigned int interrupt_source = 0);
+  ~uart();
+
+  uint64_t read(uint64_t offset, unsigned int size);
+  void write(uint64_t offset, uint64_t data, unsigned int size);
+  void flush();
+
+};
+
+#endif